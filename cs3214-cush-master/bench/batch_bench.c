@@ -0,0 +1,72 @@
+/*
+ * batch_bench - report the makespan of many short jobs submitted
+ * with batch, for several concurrency limits.
+ *
+ * Usage: batch_bench [path-to-cush [jobs [command]]]
+ */
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "cushdrv.h"
+
+#define BATCH_TIMEOUT_MS 600000
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(int ac, char *av[])
+{
+    char *cush = ac > 1 ? av[1] : "../src/cush";
+    int njobs = ac > 2 ? atoi(av[2]) : 1000;
+    char *command = ac > 3 ? av[3] : "sleep 0.01";
+    static const int limits[] = { 1, 2, 4, 8, 16, 64, 256 };
+    char line[256];
+
+    printf("%d x '%s'\n", njobs, command);
+    printf("%6s %14s %14s\n", "N", "makespan (s)", "jobs/s");
+    for (int i = 0; i < sizeof limits / sizeof limits[0]; i++) {
+        struct cushdrv drv;
+        if (!cushdrv_start(&drv, cush, (char *[]) { cush, NULL })
+                || !cushdrv_expect_prompt(&drv, NULL, 0)) {
+            fprintf(stderr, "could not start %s\n", cush);
+            return EXIT_FAILURE;
+        }
+
+        snprintf(line, sizeof line, "batch -j %d", limits[i]);
+        cushdrv_sendline(&drv, line);
+        cushdrv_expect_prompt(&drv, NULL, 0);
+
+        /* Makespan runs from the first submission until wait returns;
+         * jobs start running while later ones are still submitted. */
+        double start = now();
+        snprintf(line, sizeof line, "batch %s", command);
+        for (int j = 0; j < njobs; j++) {
+            cushdrv_sendline(&drv, line);
+            if (!cushdrv_expect(&drv, "] queued", NULL, 0, BATCH_TIMEOUT_MS)) {
+                fprintf(stderr, "shell stopped responding after %d jobs\n", j);
+                return EXIT_FAILURE;
+            }
+        }
+        /* Notifications redraw the prompt, so look for the output of
+         * a command run after wait rather than for a prompt. */
+        cushdrv_sendline(&drv, "wait");
+        cushdrv_sendline(&drv, "echo batch-done");
+        if (!cushdrv_expect(&drv, "\rbatch-done", NULL, 0, BATCH_TIMEOUT_MS)) {
+            fprintf(stderr, "wait did not return\n");
+            return EXIT_FAILURE;
+        }
+        double makespan = now() - start;
+        printf("%6d %14.3f %14.1f\n", limits[i], makespan, njobs / makespan);
+        fflush(stdout);
+        cushdrv_stop(&drv);
+    }
+    return 0;
+}
@@ -0,0 +1,157 @@
+/*
+ * Drive an interactive cush on a pseudo terminal.
+ */
+#define _GNU_SOURCE 1
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "cushdrv.h"
+
+#define CUSHDRV_TIMEOUT_MS 10000
+
+/* Start the shell with stdin read from script_fd, unless it is -1 */
+static bool
+start(struct cushdrv *drv, const char *path, char *const argv[], int script_fd)
+{
+    drv->len = 0;
+    drv->pid = forkpty(&drv->fd, NULL, NULL, NULL);
+    if (drv->pid == -1)
+        return false;
+
+    if (drv->pid == 0) {
+        if (script_fd != -1)
+            dup2(script_fd, STDIN_FILENO);
+        execv(path, argv);
+        perror(path);
+        _exit(127);
+    }
+    return true;
+}
+
+bool
+cushdrv_start(struct cushdrv *drv, const char *path, char *const argv[])
+{
+    if (!start(drv, path, argv, -1))
+        return false;
+    drv->in_fd = drv->fd;
+    return true;
+}
+
+bool
+cushdrv_start_script(struct cushdrv *drv, const char *path, char *const argv[])
+{
+    int script[2];
+    if (pipe2(script, O_CLOEXEC) == -1)
+        return false;
+    bool started = start(drv, path, argv, script[0]);
+    close(script[0]);
+    if (!started) {
+        close(script[1]);
+        return false;
+    }
+    drv->in_fd = script[1];
+    return true;
+}
+
+void
+cushdrv_sendline(struct cushdrv *drv, const char *line)
+{
+    size_t len = strlen(line);
+    char *buf = malloc(len + 1);
+    memcpy(buf, line, len);
+    buf[len] = '\n';
+
+    for (size_t off = 0; off < len + 1; ) {
+        ssize_t n = write(drv->in_fd, buf + off, len + 1 - off);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        off += n;
+    }
+    free(buf);
+}
+
+bool
+cushdrv_expect(struct cushdrv *drv, const char *needle,
+               char *out, size_t outsize, int timeout_ms)
+{
+    size_t nlen = strlen(needle);
+    for (;;) {
+        char *hit = memmem(drv->buf, drv->len, needle, nlen);
+        if (hit != NULL) {
+            size_t before = hit - drv->buf;
+            if (out != NULL && outsize > 0) {
+                size_t n = before < outsize - 1 ? before : outsize - 1;
+                memcpy(out, drv->buf, n);
+                out[n] = '\0';
+            }
+            drv->len -= before + nlen;
+            memmove(drv->buf, hit + nlen, drv->len);
+            return true;
+        }
+
+        /* Keep the tail in case the needle straddles two reads */
+        if (drv->len == sizeof drv->buf) {
+            size_t keep = nlen - 1;
+            memmove(drv->buf, drv->buf + drv->len - keep, keep);
+            drv->len = keep;
+        }
+
+        struct pollfd pfd = { .fd = drv->fd, .events = POLLIN };
+        int rc = poll(&pfd, 1, timeout_ms);
+        if (rc == -1 && errno == EINTR)
+            continue;
+        if (rc <= 0)
+            return false;
+
+        ssize_t n = read(drv->fd, drv->buf + drv->len, sizeof drv->buf - drv->len);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        drv->len += n;
+    }
+}
+
+bool
+cushdrv_expect_prompt(struct cushdrv *drv, char *out, size_t outsize)
+{
+    return cushdrv_expect(drv, CUSHDRV_PROMPT, out, outsize, CUSHDRV_TIMEOUT_MS);
+}
+
+void
+cushdrv_stop(struct cushdrv *drv)
+{
+    cushdrv_sendline(drv, "exit");
+    if (drv->in_fd != drv->fd)
+        close(drv->in_fd);
+    close(drv->fd);
+    kill(drv->pid, SIGHUP);
+    waitpid(drv->pid, NULL, 0);
+}
+
+long
+cushdrv_rss_kb(struct cushdrv *drv)
+{
+    char path[64], line[256];
+    snprintf(path, sizeof path, "/proc/%d/status", drv->pid);
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return -1;
+
+    long rss = -1;
+    while (fgets(line, sizeof line, f))
+        if (sscanf(line, "VmRSS: %ld kB", &rss) == 1)
+            break;
+    fclose(f);
+    return rss;
+}
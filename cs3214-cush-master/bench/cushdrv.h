@@ -0,0 +1,50 @@
+#ifndef __CUSHDRV_H
+#define __CUSHDRV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Drive an interactive cush on a pseudo terminal, the way a user
+ * (or the pexpect tests) would, or one that reads a script from a
+ * pipe and writes to the terminal.
+ */
+#define CUSHDRV_PROMPT "cush> "
+
+struct cushdrv {
+    pid_t pid;               /* the shell */
+    int fd;                  /* master side of the shell's pty */
+    int in_fd;               /* where input is written: fd, or the
+                                script pipe */
+    char buf[1 << 16];       /* output read but not yet consumed */
+    size_t len;
+};
+
+/* Start the shell at path with the given NULL-terminated argv.
+ * Returns false if it could not be started. */
+bool cushdrv_start(struct cushdrv *drv, const char *path, char *const argv[]);
+
+/* Like cushdrv_start, but the shell's stdin is a pipe, as if it ran
+ * a script.  The shell prints no prompts then. */
+bool cushdrv_start_script(struct cushdrv *drv, const char *path, char *const argv[]);
+
+/* Send one line of input */
+void cushdrv_sendline(struct cushdrv *drv, const char *line);
+
+/* Read until needle appears.  On success, copy the output preceding
+ * needle into out (if non-NULL, truncated to outsize) and consume it
+ * together with needle.  Returns false on timeout or EOF. */
+bool cushdrv_expect(struct cushdrv *drv, const char *needle,
+                    char *out, size_t outsize, int timeout_ms);
+
+/* Wait for the next prompt; see cushdrv_expect */
+bool cushdrv_expect_prompt(struct cushdrv *drv, char *out, size_t outsize);
+
+/* Terminate the shell and reap it */
+void cushdrv_stop(struct cushdrv *drv);
+
+/* Return the shell's resident set size in KiB, or -1 */
+long cushdrv_rss_kb(struct cushdrv *drv);
+
+#endif /* __CUSHDRV_H */
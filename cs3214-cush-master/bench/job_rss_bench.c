@@ -0,0 +1,63 @@
+/*
+ * job_rss_bench - report the shell's resident set size as the
+ * number of live background jobs grows.
+ *
+ * Usage: job_rss_bench [path-to-cush [max-jobs]]
+ */
+#define _GNU_SOURCE 1
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cushdrv.h"
+
+int
+main(int ac, char *av[])
+{
+    char *cush = ac > 1 ? av[1] : "../src/cush";
+    int maxjobs = ac > 2 ? atoi(av[2]) : 2000;
+    struct cushdrv drv;
+    char out[1024];
+
+    if (!cushdrv_start(&drv, cush, (char *[]) { cush, NULL })
+            || !cushdrv_expect_prompt(&drv, NULL, 0)) {
+        fprintf(stderr, "could not start %s\n", cush);
+        return EXIT_FAILURE;
+    }
+
+    pid_t *pids = calloc(maxjobs, sizeof *pids);
+    long base = cushdrv_rss_kb(&drv);
+    printf("%8s %12s %14s\n", "jobs", "rss (KiB)", "KiB/job");
+    printf("%8d %12ld %14s\n", 0, base, "-");
+
+    int njobs = 0;
+    for (int checkpoint = 250; njobs < maxjobs; checkpoint *= 2) {
+        if (checkpoint > maxjobs)
+            checkpoint = maxjobs;
+        for (; njobs < checkpoint; njobs++) {
+            int jid;
+            cushdrv_sendline(&drv, "sleep 1000 &");
+            if (!cushdrv_expect_prompt(&drv, out, sizeof out)) {
+                fprintf(stderr, "shell stopped responding after %d jobs\n", njobs);
+                goto out;
+            }
+            /* find the "[jid] pid" line among echo and escape sequences */
+            pids[njobs] = 0;
+            for (char *bg = strchr(out, '['); bg != NULL; bg = strchr(bg + 1, '['))
+                if (sscanf(bg, "[%d] %d", &jid, &pids[njobs]) == 2)
+                    break;
+        }
+        long rss = cushdrv_rss_kb(&drv);
+        printf("%8d %12ld %14.2f\n", njobs, rss, (double) (rss - base) / njobs);
+        fflush(stdout);
+    }
+
+out:
+    for (int i = 0; i < njobs; i++)
+        if (pids[i] > 0)
+            kill(pids[i], SIGTERM);
+    cushdrv_stop(&drv);
+    free(pids);
+    return 0;
+}
@@ -0,0 +1,305 @@
+/*
+ * latency_bench - measure how fast cush launches commands, and how
+ * fast processes start without a shell, and write the results as
+ * JSON so they can be compared between builds.
+ *
+ * The shell runs each workload line over and over, interactively on
+ * a pty, where a line is done when the next prompt appears, and as a
+ * script read from a pipe, where each line is followed by pwd and is
+ * done when pwd's output appears.  The workloads are true, pipelines
+ * of 2, 10 and 50 stages, redirections, bursts of background jobs,
+ * true with variable assignments, and a builtin piped into cat.  For each, the commands run per
+ * second and the p50 and p99 latency of a line are reported.
+ *
+ * Without a shell, /bin/true is started and waited for with fork and
+ * execv, vfork and execv, the C library's posix_spawn, and libspawn's
+ * posix_spawn.
+ *
+ * Usage: latency_bench [-n lines] [-o results.json] [path-to-cush [option...]]
+ */
+#define _GNU_SOURCE 1
+#include <dlfcn.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "cushdrv.h"
+#include "spawn.h"
+
+#define BURST_JOBS 20
+#define WARMUP_LINES 10
+
+struct workload {
+    const char *name;
+    char line[4096];
+    int commands;            /* per line */
+    bool background;         /* the line's jobs must be waited for */
+};
+
+struct result {
+    const char *mode;
+    const char *name;
+    double commands_per_sec;
+    double p50_us, p99_us;
+};
+
+static struct result results[32];
+static int num_results;
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+/* Record a result from the latencies of n runs of commands each */
+static void
+add_result(const char *mode, const char *name, double *latencies, int n, int commands)
+{
+    double total = 0;
+    for (int i = 0; i < n; i++)
+        total += latencies[i];
+    qsort(latencies, n, sizeof *latencies, compare_doubles);
+    struct result *r = &results[num_results++];
+    *r = (struct result) {
+        .mode = mode,
+        .name = name,
+        .commands_per_sec = n * commands / total,
+        .p50_us = latencies[n / 2] * 1e6,
+        .p99_us = latencies[(n * 99) / 100] * 1e6,
+    };
+    printf("%-12s %-14s %12.1f %12.1f %12.1f\n", r->mode, r->name,
+           r->commands_per_sec, r->p50_us, r->p99_us);
+    fflush(stdout);
+}
+
+/* Wait until the shell has run everything sent so far */
+static bool
+sync_shell(struct cushdrv *drv, bool script, const char *cwd)
+{
+    if (!script)
+        return cushdrv_expect_prompt(drv, NULL, 0);
+    char marker[PATH_MAX + 2];
+    snprintf(marker, sizeof marker, "%s\r\n", cwd);
+    cushdrv_sendline(drv, "pwd");
+    return cushdrv_expect(drv, marker, NULL, 0, 10000);
+}
+
+/* Run workload w nlines times in the shell; returns false if the
+ * shell stopped responding */
+static bool
+bench_shell(const char *mode, char *const argv[], struct workload *w, int nlines)
+{
+    bool script = strcmp(mode, "script") == 0;
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof cwd) == NULL)
+        return false;
+
+    struct cushdrv drv;
+    if (!(script ? cushdrv_start_script : cushdrv_start)(&drv, argv[0], argv))
+        return false;
+    if (!script && !cushdrv_expect_prompt(&drv, NULL, 0))
+        return false;
+
+    double *latencies = calloc(nlines, sizeof *latencies);
+    bool ok = true;
+    for (int i = -WARMUP_LINES; ok && i < nlines; i++) {
+        double start = now();
+        cushdrv_sendline(&drv, w->line);
+        ok = sync_shell(&drv, script, cwd);
+        if (i >= 0)
+            latencies[i] = now() - start;
+        /* Reap the jobs, and let their notifications pass, before
+         * the next line is timed */
+        if (ok && w->background) {
+            cushdrv_sendline(&drv, "wait");
+            ok = sync_shell(&drv, script, cwd);
+            if (ok && !script)
+                ok = sync_shell(&drv, true, cwd) && sync_shell(&drv, false, cwd);
+        }
+    }
+    cushdrv_stop(&drv);
+    if (ok)
+        add_result(mode, w->name, latencies, nlines, w->commands);
+    free(latencies);
+    return ok;
+}
+
+static int
+spawn_fork(pid_t *pid, char *argv[])
+{
+    extern char **environ;
+    if ((*pid = fork()) == 0) {
+        execve(argv[0], argv, environ);
+        _exit(127);
+    }
+    return *pid == -1;
+}
+
+static int
+spawn_vfork(pid_t *pid, char *argv[])
+{
+    extern char **environ;
+    if ((*pid = vfork()) == 0) {
+        execve(argv[0], argv, environ);
+        _exit(127);
+    }
+    return *pid == -1;
+}
+
+static int (*libc_posix_spawn)(pid_t *, const char *, const posix_spawn_file_actions_t *,
+                               const posix_spawnattr_t *, char *const [], char *const []);
+
+static int
+spawn_libc(pid_t *pid, char *argv[])
+{
+    extern char **environ;
+    return libc_posix_spawn(pid, argv[0], NULL, NULL, argv, environ);
+}
+
+static int
+spawn_libspawn(pid_t *pid, char *argv[])
+{
+    extern char **environ;
+    return posix_spawn(pid, argv[0], NULL, NULL, argv, environ);
+}
+
+/* Start /bin/true with spawn and wait for it, n times */
+static void
+bench_raw(const char *name, int (*spawn)(pid_t *, char *[]), int n)
+{
+    char *argv[] = { "/bin/true", NULL };
+    double *latencies = calloc(n, sizeof *latencies);
+    for (int i = 0; i < n; i++) {
+        double start = now();
+        pid_t pid;
+        if (spawn(&pid, argv) != 0 || waitpid(pid, NULL, 0) != pid) {
+            fprintf(stderr, "%s: could not start /bin/true\n", name);
+            exit(EXIT_FAILURE);
+        }
+        latencies[i] = now() - start;
+    }
+    add_result("raw", name, latencies, n, 1);
+    free(latencies);
+}
+
+static void
+write_json(const char *path, int nlines, char *const argv[])
+{
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(f, "{\n  \"cpus\": %ld,\n  \"lines\": %d,\n  \"shell\": \"",
+            sysconf(_SC_NPROCESSORS_ONLN), nlines);
+    for (int i = 0; argv[i] != NULL; i++)
+        fprintf(f, "%s%s", i ? " " : "", argv[i]);
+    fprintf(f, "\",\n  \"results\": [\n");
+    for (int i = 0; i < num_results; i++) {
+        struct result *r = &results[i];
+        fprintf(f, "    { \"mode\": \"%s\", \"workload\": \"%s\", "
+                "\"commands_per_sec\": %.1f, \"p50_us\": %.1f, \"p99_us\": %.1f }%s\n",
+                r->mode, r->name, r->commands_per_sec, r->p50_us, r->p99_us,
+                i < num_results - 1 ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+}
+
+/* Make a line of n stages, the first of which is true */
+static void
+make_pipeline(struct workload *w, const char *name, int n)
+{
+    w->name = name;
+    w->commands = n;
+    strcpy(w->line, "true");
+    for (int i = 1; i < n; i++)
+        strcat(w->line, " | cat");
+}
+
+int
+main(int ac, char *av[])
+{
+    int nlines = 200;
+    const char *json = "latency_bench.json";
+    int opt;
+    while ((opt = getopt(ac, av, "+n:o:")) > 0) {
+        switch (opt) {
+        case 'n':
+            nlines = atoi(optarg);
+            break;
+        case 'o':
+            json = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n lines] [-o results.json] [path-to-cush [option...]]\n", av[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (nlines < 1)
+        nlines = 1;
+    char *default_argv[] = { "../src/cush", NULL };
+    char **cush_argv = optind < ac ? av + optind : default_argv;
+
+    char tmpfile[] = "/tmp/latency_bench.XXXXXX";
+    int fd = mkstemp(tmpfile);
+    if (fd == -1 || write(fd, "hello\n", 6) != 6) {
+        perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+
+    static struct workload workloads[8];
+    workloads[0] = (struct workload) { .name = "true", .line = "true", .commands = 1 };
+    make_pipeline(&workloads[1], "pipe2", 2);
+    make_pipeline(&workloads[2], "pipe10", 10);
+    make_pipeline(&workloads[3], "pipe50", 50);
+    workloads[4] = (struct workload) { .name = "redirect", .commands = 1 };
+    snprintf(workloads[4].line, sizeof workloads[4].line, "cat < %s > /dev/null", tmpfile);
+    workloads[5] = (struct workload) { .name = "bg_burst", .commands = BURST_JOBS,
+                                       .background = true };
+    for (int i = 0; i < BURST_JOBS; i++)
+        strcat(workloads[5].line, "true & ");
+    workloads[6] = (struct workload) { .name = "assign", .line = "FOO=1 HOME=/ true",
+                                       .commands = 1 };
+    workloads[7] = (struct workload) { .name = "builtin_pipe", .line = "pwd | cat",
+                                       .commands = 2 };
+
+    printf("%-12s %-14s %12s %12s %12s\n", "mode", "workload", "commands/s",
+           "p50 us", "p99 us");
+    static const char *modes[] = { "interactive", "script" };
+    for (int m = 0; m < 2; m++)
+        for (int i = 0; i < sizeof workloads / sizeof workloads[0]; i++)
+            if (!bench_shell(modes[m], cush_argv, &workloads[i], nlines)) {
+                fprintf(stderr, "%s: shell stopped responding in %s mode\n",
+                        workloads[i].name, modes[m]);
+                return EXIT_FAILURE;
+            }
+
+    libc_posix_spawn = dlsym(RTLD_NEXT, "posix_spawn");
+    bench_raw("fork_exec", spawn_fork, nlines * 5);
+    bench_raw("vfork_exec", spawn_vfork, nlines * 5);
+    if (libc_posix_spawn != NULL)
+        bench_raw("libc_spawn", spawn_libc, nlines * 5);
+    bench_raw("libspawn", spawn_libspawn, nlines * 5);
+
+    unlink(tmpfile);
+    write_json(json, nlines, cush_argv);
+    printf("results written to %s\n", json);
+    return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * pipeline_bench - measure how long it takes to start all stages of
+ * a pipeline of `cat`s, reading from /dev/null.
+ *
+ * Compares posix_spawn_pipeline_np with spawning the stages one at
+ * a time the way cush used to: a fresh attribute and file action
+ * list for each stage, built with the C library's add functions.
+ * posix_spawn_pipeline_np is measured twice: from the calling thread
+ * alone, and with stages spawned from as many threads as there are
+ * CPUs (at least 2).  Only the time until the last stage is spawned
+ * counts; the stages are reaped afterwards.
+ *
+ * Usage: pipeline_bench [pipelines]
+ */
+#define _GNU_SOURCE 1
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "spawn.h"
+
+static char *cat_argv[] = { "cat", NULL };
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+reap_all(void)
+{
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR)
+        continue;
+}
+
+/* Spawn the stages one by one; returns the time it took */
+static double
+start_stages(int nstages)
+{
+    extern char **environ;
+    double start = now();
+    int prev_read = -1;
+    pid_t pgrp = 0;
+    for (int i = 0; i < nstages; i++) {
+        int fds[2];
+        if (i < nstages - 1 && pipe2(fds, O_CLOEXEC) != 0) {
+            perror("pipe2");
+            exit(EXIT_FAILURE);
+        }
+        posix_spawnattr_t attr;
+        posix_spawn_file_actions_t fa;
+        posix_spawnattr_init(&attr);
+        posix_spawn_file_actions_init(&fa);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+        posix_spawnattr_setpgroup(&attr, pgrp);
+        if (i == 0)
+            posix_spawn_file_actions_addopen(&fa, 0, "/dev/null", O_RDONLY, 0);
+        else
+            posix_spawn_file_actions_adddup2(&fa, prev_read, 0);
+        if (i < nstages - 1)
+            posix_spawn_file_actions_adddup2(&fa, fds[1], 1);
+        else
+            posix_spawn_file_actions_addopen(&fa, 1, "/dev/null", O_WRONLY, 0);
+        posix_spawn_file_actions_addclosefrom_np(&fa, 3);
+        pid_t pid;
+        if (posix_spawn(&pid, "/bin/cat", &fa, &attr, cat_argv, environ) != 0) {
+            fprintf(stderr, "posix_spawn failed\n");
+            exit(EXIT_FAILURE);
+        }
+        if (pgrp == 0)
+            pgrp = pid;
+        posix_spawn_file_actions_destroy(&fa);
+        posix_spawnattr_destroy(&attr);
+        if (prev_read != -1)
+            close(prev_read);
+        if (i < nstages - 1) {
+            close(fds[1]);
+            prev_read = fds[0];
+        }
+    }
+    return now() - start;
+}
+
+/* Spawn the stages with posix_spawn_pipeline_np; returns the time it took */
+static double
+start_pipeline(int nstages, int nworkers)
+{
+    extern char **environ;
+    struct posix_spawn_stage stages[nstages];
+    for (int i = 0; i < nstages; i++)
+        stages[i] = (struct posix_spawn_stage) { .path = "/bin/cat", .argv = cat_argv };
+    struct posix_spawn_pipeline pipeline = {
+        .stages = stages,
+        .nstages = nstages,
+        .input = "/dev/null",
+        .output = "/dev/null",
+        .nworkers = nworkers,
+    };
+    double start = now();
+    if (posix_spawn_pipeline_np(&pipeline, NULL, environ) != 0) {
+        fprintf(stderr, "posix_spawn_pipeline_np failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return now() - start;
+}
+
+int
+main(int ac, char *av[])
+{
+    int npipelines = ac > 1 ? atoi(av[1]) : 100;
+    int sizes[] = { 2, 10, 50, 100 };
+    int nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nworkers < 2)
+        nworkers = 2;
+
+    printf("%d CPUs\n", (int) sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%8s %16s %16s %16s\n", "stages", "one-by-one us", "pipeline us",
+           "parallel us");
+    for (int i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+        double one_by_one = 0, pipeline = 0, parallel = 0;
+        for (int j = 0; j < npipelines; j++) {
+            one_by_one += start_stages(sizes[i]);
+            reap_all();
+            pipeline += start_pipeline(sizes[i], 1);
+            reap_all();
+            parallel += start_pipeline(sizes[i], nworkers);
+            reap_all();
+        }
+        printf("%8d %16.1f %16.1f %16.1f\n", sizes[i],
+               one_by_one / npipelines * 1e6, pipeline / npipelines * 1e6,
+               parallel / npipelines * 1e6);
+    }
+    return 0;
+}
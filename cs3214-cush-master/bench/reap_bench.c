@@ -0,0 +1,72 @@
+/*
+ * reap_bench - measure the cost of finding the job a reaped
+ * child belongs to as the number of live jobs grows.
+ *
+ * Models what handle_child_status() does per SIGCHLD: look up the
+ * pid, drop it from the index, and (to keep the job count steady)
+ * index the pid of a replacement child.
+ */
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "pid_table.h"
+
+#define PIDS_PER_JOB 3
+#define REAPS 1000000
+
+struct fake_job {
+    pid_t pids[PIDS_PER_JOB];
+};
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double
+bench_reap(int njobs)
+{
+    struct pid_table table;
+    struct fake_job *jobs = calloc(njobs, sizeof *jobs);
+    pid_t nextpid = 300;
+
+    pid_table_init(&table);
+    for (int j = 0; j < njobs; j++)
+        for (int p = 0; p < PIDS_PER_JOB; p++) {
+            jobs[j].pids[p] = nextpid++;
+            pid_table_insert(&table, jobs[j].pids[p], &jobs[j]);
+        }
+
+    unsigned int seed = 42;
+    double start = now();
+    for (int i = 0; i < REAPS; i++) {
+        struct fake_job *job = &jobs[rand_r(&seed) % njobs];
+        int p = rand_r(&seed) % PIDS_PER_JOB;
+        if (pid_table_lookup(&table, job->pids[p]) != job)
+            abort();
+        pid_table_remove(&table, job->pids[p]);
+        job->pids[p] = nextpid++;
+        pid_table_insert(&table, job->pids[p], job);
+    }
+    double elapsed = now() - start;
+
+    pid_table_destroy(&table);
+    free(jobs);
+    return elapsed / REAPS * 1e9;
+}
+
+int
+main(int ac, char *av[])
+{
+    int counts[] = { 10, 100, 1000, 10000 };
+
+    printf("%8s %14s\n", "jobs", "ns/reap");
+    for (int i = 0; i < sizeof counts / sizeof counts[0]; i++)
+        printf("%8d %14.1f\n", counts[i], bench_reap(counts[i]));
+    return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * spawn_bench - report how many foreground commands per second the
+ * shell runs when the command is found late on a long PATH.
+ *
+ * For each PATH length, the shell is started with that many empty
+ * directories in front of the original PATH and runs a command
+ * found by PATH search over and over.  Run it against builds with
+ * and without the path cache to compare them.
+ *
+ * Usage: spawn_bench [path-to-cush [commands [command]]]
+ */
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cushdrv.h"
+
+#define MAX_EXTRA_DIRS 64
+/* Commands are sent several to a line, separated by ';', so the pty
+ * round trip per line does not dominate */
+#define COMMANDS_PER_LINE 20
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(int ac, char *av[])
+{
+    char *cush = ac > 1 ? av[1] : "../src/cush";
+    int ncommands = ac > 2 ? atoi(av[2]) : 2000;
+    char *command = ac > 3 ? av[3] : "true";
+    static const int extra_dirs[] = { 0, 8, 32, MAX_EXTRA_DIRS };
+
+    char tmpdir[] = "/tmp/spawn_bench.XXXXXX";
+    if (mkdtemp(tmpdir) == NULL) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    char *orig_path = strdup(getenv("PATH") ? getenv("PATH") : "/bin:/usr/bin");
+    char dirs[MAX_EXTRA_DIRS][64];
+    for (int i = 0; i < MAX_EXTRA_DIRS; i++) {
+        snprintf(dirs[i], sizeof dirs[i], "%s/%d", tmpdir, i);
+        mkdir(dirs[i], 0755);
+    }
+
+    printf("%d x '%s'\n", ncommands, command);
+    printf("%10s %14s %14s\n", "extra dirs", "commands/s", "us/command");
+    for (int i = 0; i < sizeof extra_dirs / sizeof extra_dirs[0]; i++) {
+        size_t len = strlen(orig_path) + 1 + extra_dirs[i] * sizeof dirs[0];
+        char *path = calloc(1, len);
+        for (int d = 0; d < extra_dirs[i]; d++) {
+            strcat(path, dirs[d]);
+            strcat(path, ":");
+        }
+        strcat(path, orig_path);
+        setenv("PATH", path, 1);
+        free(path);
+
+        char line[COMMANDS_PER_LINE * 256] = "";
+        for (int c = 0; c < COMMANDS_PER_LINE; c++) {
+            strncat(line, command, 250);
+            strcat(line, "; ");
+        }
+
+        struct cushdrv drv;
+        if (!cushdrv_start(&drv, cush, (char *[]) { cush, NULL })
+                || !cushdrv_expect_prompt(&drv, NULL, 0)) {
+            fprintf(stderr, "could not start %s\n", cush);
+            return EXIT_FAILURE;
+        }
+        double start = now();
+        for (int j = 0; j < ncommands; j += COMMANDS_PER_LINE) {
+            cushdrv_sendline(&drv, line);
+            if (!cushdrv_expect_prompt(&drv, NULL, 0)) {
+                fprintf(stderr, "shell stopped responding after %d commands\n", j);
+                return EXIT_FAILURE;
+            }
+        }
+        double elapsed = now() - start;
+        ncommands = (ncommands + COMMANDS_PER_LINE - 1) / COMMANDS_PER_LINE * COMMANDS_PER_LINE;
+        printf("%10d %14.1f %14.1f\n", extra_dirs[i], ncommands / elapsed,
+               elapsed / ncommands * 1e6);
+        fflush(stdout);
+        cushdrv_stop(&drv);
+    }
+
+    for (int i = 0; i < MAX_EXTRA_DIRS; i++)
+        rmdir(dirs[i]);
+    rmdir(tmpdir);
+    return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * spawn_helper_bench - compare the throughput of spawning bursts of
+ * one-command jobs (`true`) in-process with posix_spawn_pipeline_np
+ * and through cush's spawn helper.
+ *
+ * For each burst size, jobs are started in bursts: in-process one
+ * after the other, or by sending the whole burst to the helper and
+ * then collecting its replies, as cush does for the background jobs
+ * of one command line (cush collects them as they arrive, and at the
+ * latest once about 100 are outstanding, so larger bursts are not
+ * measured).  Reported are the jobs started per second
+ * and, for the helper, the part of the time the caller spent sending
+ * requests, which is all the time the shell is kept from other work.
+ * Children are reaped after each burst, outside the timed part.
+ *
+ * Usage: spawn_helper_bench [jobs]
+ */
+#define _GNU_SOURCE 1
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "spawn.h"
+#include "spawn_helper.h"
+
+static char *true_argv[] = { "true", NULL };
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Reap the n children spawned last */
+static void
+reap(int n)
+{
+    while (n > 0)
+        if (waitpid(-1, NULL, 0) > 0)
+            n--;
+        else if (errno != EINTR) {
+            perror("waitpid");
+            exit(EXIT_FAILURE);
+        }
+}
+
+static void
+init_pipeline(struct posix_spawn_pipeline *pipeline, struct posix_spawn_stage *stage)
+{
+    *stage = (struct posix_spawn_stage) { .path = "/bin/true", .argv = true_argv };
+    *pipeline = (struct posix_spawn_pipeline) {
+        .stages = stage,
+        .nstages = 1,
+        .output = "/dev/null",
+        .nworkers = 1,
+    };
+}
+
+/* Spawn burst jobs in-process; returns the time it took */
+static double
+burst_in_process(int burst, posix_spawnattr_t *attr)
+{
+    extern char **environ;
+    double start = now();
+    for (int i = 0; i < burst; i++) {
+        struct posix_spawn_stage stage;
+        struct posix_spawn_pipeline pipeline;
+        init_pipeline(&pipeline, &stage);
+        if (posix_spawn_pipeline_np(&pipeline, attr, environ) != 0) {
+            fprintf(stderr, "posix_spawn_pipeline_np failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return now() - start;
+}
+
+/* Spawn burst jobs through the helper; returns the time it took, and
+ * the time spent sending requests in *sending */
+static double
+burst_helper(int burst, posix_spawnattr_t *attr, double *sending)
+{
+    double start = now();
+    for (int i = 0; i < burst; i++) {
+        struct posix_spawn_stage stage;
+        struct posix_spawn_pipeline pipeline;
+        init_pipeline(&pipeline, &stage);
+        if (spawn_helper_submit(&pipeline, attr, NULL) != 0) {
+            fprintf(stderr, "spawn_helper_submit failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    *sending += now() - start;
+    for (int i = 0; i < burst; i++) {
+        struct posix_spawn_stage stage;
+        struct posix_spawn_pipeline pipeline;
+        init_pipeline(&pipeline, &stage);
+        if (spawn_helper_complete(&pipeline) != 0) {
+            fprintf(stderr, "the helper could not spawn a job\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return now() - start;
+}
+
+int
+main(int ac, char *av[])
+{
+    int njobs = ac > 1 ? atoi(av[1]) : 2000;
+    int bursts[] = { 1, 10, 50, 100 };
+    if (!spawn_helper_start())
+        return EXIT_FAILURE;
+    extern char **environ;
+    env_table_init(environ);
+
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attr, 0);
+
+    printf("%d CPUs, %d jobs\n", (int) sysconf(_SC_NPROCESSORS_ONLN), njobs);
+    printf("%8s %16s %16s %16s\n", "burst", "in-process j/s", "helper j/s",
+           "helper send %");
+    for (int i = 0; i < sizeof bursts / sizeof bursts[0]; i++) {
+        int burst = bursts[i];
+        double in_process = 0, helper = 0, sending = 0;
+        for (int done = 0; done < njobs; done += burst) {
+            in_process += burst_in_process(burst, &attr);
+            reap(burst);
+            helper += burst_helper(burst, &attr, &sending);
+            reap(burst);
+        }
+        int total = (njobs + burst - 1) / burst * burst;
+        printf("%8d %16.0f %16.0f %16.1f\n", burst, total / in_process,
+               total / helper, 100 * sending / helper);
+    }
+    return 0;
+}
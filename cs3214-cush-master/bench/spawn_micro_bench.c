@@ -0,0 +1,93 @@
+/*
+ * spawn_micro_bench - report how many processes per second libspawn
+ * starts, spawning /bin/true and waiting for it, one at a time.
+ *
+ * Argument vectors that fit a pooled child stack, which holds up to
+ * about 130000 entries, are compared with one that is too large for
+ * it and needs a stack of its own.  Each
+ * is measured first with the child checking every signal's
+ * disposition, then with only the signals recorded as handled
+ * (as cush does), and last with that and all the resource limits
+ * cush's ulimit knows set in the child, which should cost no more.
+ *
+ * Usage: spawn_micro_bench [spawns]
+ */
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "spawn.h"
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double
+bench_spawn(int nspawns, int argc, const posix_spawnattr_t *attr)
+{
+    extern char **environ;
+    char **argv = calloc(argc + 1, sizeof *argv);
+    argv[0] = "true";
+    for (int i = 1; i < argc; i++)
+        argv[i] = "x";
+
+    double start = now();
+    for (int i = 0; i < nspawns; i++) {
+        pid_t pid;
+        int rc = posix_spawn(&pid, "/bin/true", NULL, attr, argv, environ);
+        if (rc != 0) {
+            fprintf(stderr, "posix_spawn failed: %d\n", rc);
+            exit(EXIT_FAILURE);
+        }
+        waitpid(pid, NULL, 0);
+    }
+    double elapsed = now() - start;
+    free(argv);
+    return nspawns / elapsed;
+}
+
+int
+main(int ac, char *av[])
+{
+    int nspawns = ac > 1 ? atoi(av[1]) : 5000;
+    int argcs[] = { 1, 100, 10000, 140000 };
+
+    /* The limits are set to what they are, so the children behave
+     * the same either way */
+    static const int resources[] = {
+        RLIMIT_CORE, RLIMIT_DATA, RLIMIT_FSIZE, RLIMIT_MEMLOCK, RLIMIT_NOFILE,
+        RLIMIT_STACK, RLIMIT_CPU, RLIMIT_NPROC, RLIMIT_AS,
+    };
+    struct rlimit limits[RLIM_NLIMITS];
+    unsigned int mask = 0;
+    for (int i = 0; i < sizeof resources / sizeof resources[0]; i++) {
+        getrlimit(resources[i], &limits[resources[i]]);
+        mask |= 1U << resources[i];
+    }
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+
+    printf("%8s %10s %8s %14s %14s\n", "argc", "signals", "rlimits", "spawns/s", "us/spawn");
+    for (int pass = 0; pass < 3; pass++) {
+        if (pass == 1)
+            posix_spawn_addhandled_np(SIGINT);
+        if (pass == 2)
+            posix_spawnattr_setrlimit_np(&attr, mask, limits);
+        for (int i = 0; i < sizeof argcs / sizeof argcs[0]; i++) {
+            double rate = bench_spawn(nspawns, argcs[i], &attr);
+            printf("%8d %10s %8d %14.1f %14.1f\n", argcs[i],
+                   pass > 0 ? "recorded" : "all", pass == 2 ? __builtin_popcount(mask) : 0,
+                   rate, 1e6 / rate);
+        }
+    }
+    posix_spawnattr_destroy(&attr);
+    return 0;
+}
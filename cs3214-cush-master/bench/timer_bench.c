@@ -0,0 +1,73 @@
+/*
+ * timer_bench - measure the cost of scheduling and cancelling job
+ * deadlines as the number of pending deadlines grows.
+ *
+ * Models a shell with many jobs started under timeout: each step
+ * cancels one deadline (its job finished early), expires the
+ * earliest, and schedules two new ones to keep the count steady.
+ */
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "timer_heap.h"
+
+#define STEPS 1000000
+
+struct fake_job {
+    struct timer_heap_elem deadline;
+};
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double
+bench_timers(int njobs)
+{
+    struct timer_heap heap;
+    struct fake_job *jobs = calloc(njobs, sizeof *jobs);
+    unsigned int seed = 42;
+    long long clock = 0;
+
+    timer_heap_init(&heap);
+    for (int j = 0; j < njobs; j++) {
+        timer_heap_elem_init(&jobs[j].deadline);
+        timer_heap_add(&heap, &jobs[j].deadline, rand_r(&seed) % 100000);
+    }
+
+    double start = now();
+    for (int i = 0; i < STEPS; i++) {
+        struct fake_job *job = &jobs[rand_r(&seed) % njobs];
+        timer_heap_remove(&heap, &job->deadline);
+
+        struct timer_heap_elem *first = timer_heap_min(&heap);
+        struct fake_job *expired = timer_heap_entry(first, struct fake_job, deadline);
+        clock = first->expiry;
+        timer_heap_remove(&heap, first);
+
+        timer_heap_add(&heap, &job->deadline, clock + rand_r(&seed) % 100000);
+        timer_heap_add(&heap, &expired->deadline, clock + rand_r(&seed) % 100000);
+    }
+    double elapsed = now() - start;
+
+    timer_heap_destroy(&heap);
+    free(jobs);
+    return elapsed / STEPS * 1e9;
+}
+
+int
+main(int ac, char *av[])
+{
+    int counts[] = { 10, 1000, 10000, 100000 };
+
+    printf("%8s %14s\n", "timers", "ns/step");
+    for (int i = 0; i < sizeof counts / sizeof counts[0]; i++)
+        printf("%8d %14.1f\n", counts[i], bench_timers(counts[i]));
+    return 0;
+}
@@ -21,6 +21,7 @@
 
 #include <features.h>
 #include <sched.h>
+#include <sys/resource.h>
 #include <sys/types.h>
 #include <bits/types/sigset_t.h>
 
@@ -35,7 +36,15 @@ typedef struct
   struct sched_param __sp;
   int __policy;
   int __tcpgrp;
-  int __pad[15];
+  int __cgroup;
+  int *__pidfd;
+  const void *__cpuset;
+  size_t __cpusetsize;
+  int __ioprio;
+  int __nice;
+  const struct rlimit *__rlimits;
+  unsigned int __rlimitmask;
+  int __pad[3];
 } posix_spawnattr_t;
 
 
@@ -61,6 +70,12 @@ typedef struct
 # define POSIX_SPAWN_USEVFORK		0x40
 # define POSIX_SPAWN_SETSID		0x80
 # define POSIX_SPAWN_TCSETPGROUP	0x100
+# define POSIX_SPAWN_SETCGROUP		0x200
+# define POSIX_SPAWN_PIDFD		0x400
+# define POSIX_SPAWN_SETPARENT		0x800
+# define POSIX_SPAWN_SETAFFINITY	0x1000
+# define POSIX_SPAWN_SETIOPRIO		0x2000
+# define POSIX_SPAWN_SETNICE		0x4000
 #endif
 
 
@@ -179,6 +194,160 @@ extern int posix_spawnattr_tcsetpgrp_np (posix_spawnattr_t *__attr, int fd)
 extern int posix_spawnattr_tcgetpgrp_np (const posix_spawnattr_t *
 					 __restrict __attr, int *fd)
      __THROW __nonnull ((1, 2));
+
+/* Make the spawned process a member of the cgroup v2 whose directory
+   is open as CGROUP (used if POSIX_SPAWN_SETCGROUP is set).  */
+extern int posix_spawnattr_setcgroup_np (posix_spawnattr_t *__attr,
+					 int __cgroup)
+     __THROW __nonnull ((1));
+
+/* Return the cgroup directory FD in the attribute structure.  */
+extern int posix_spawnattr_getcgroup_np (const posix_spawnattr_t *
+					 __restrict __attr,
+					 int *__restrict __cgroup)
+     __THROW __nonnull ((1, 2));
+
+/* Store a pidfd for the spawned process in *PIDFD (used if
+   POSIX_SPAWN_PIDFD is set).  The pidfd is created together with the
+   process and is close-on-exec.  */
+extern int posix_spawnattr_setpidfd_np (posix_spawnattr_t *__attr,
+					int *__pidfd)
+     __THROW __nonnull ((1, 2));
+
+/* Return the location for the pidfd in the attribute structure.  */
+extern int posix_spawnattr_getpidfd_np (const posix_spawnattr_t *
+					__restrict __attr,
+					int **__restrict __pidfd)
+     __THROW __nonnull ((1, 2));
+
+/* Restrict the spawned process to the CPUs in *CPUSET, of CPUSETSIZE
+   bytes (used if POSIX_SPAWN_SETAFFINITY is set).  *CPUSET is not
+   copied, and must remain valid until the process is spawned.  */
+extern int posix_spawnattr_setaffinity_np (posix_spawnattr_t *__attr,
+					   size_t __cpusetsize,
+					   const cpu_set_t *__cpuset)
+     __THROW __nonnull ((1, 3));
+
+/* Copy the CPU set in the attribute structure to *CPUSET, of
+   CPUSETSIZE bytes.  */
+extern int posix_spawnattr_getaffinity_np (const posix_spawnattr_t *
+					   __restrict __attr,
+					   size_t __cpusetsize,
+					   cpu_set_t *__restrict __cpuset)
+     __THROW __nonnull ((1, 3));
+
+/* Give the spawned process the I/O priority IOPRIO, as for ioprio_set
+   (used if POSIX_SPAWN_SETIOPRIO is set).  */
+extern int posix_spawnattr_setioprio_np (posix_spawnattr_t *__attr,
+					 int __ioprio)
+     __THROW __nonnull ((1));
+
+/* Return the I/O priority in the attribute structure.  */
+extern int posix_spawnattr_getioprio_np (const posix_spawnattr_t *
+					 __restrict __attr,
+					 int *__restrict __ioprio)
+     __THROW __nonnull ((1, 2));
+
+/* Give the spawned process the nice value NICE (used if
+   POSIX_SPAWN_SETNICE is set).  */
+extern int posix_spawnattr_setnice_np (posix_spawnattr_t *__attr,
+				       int __nice)
+     __THROW __nonnull ((1));
+
+/* Return the nice value in the attribute structure.  */
+extern int posix_spawnattr_getnice_np (const posix_spawnattr_t *
+				       __restrict __attr,
+				       int *__restrict __nice)
+     __THROW __nonnull ((1, 2));
+
+/* Set the resource limits of the spawned process: for each resource R
+   whose bit (1U << R) is set in MASK, LIMITS[R].  The limits are set
+   after the file actions, just before the process executes.  *LIMITS
+   is not copied, and must remain valid until the process is spawned.
+   A MASK of 0 leaves the limits alone.  */
+extern int posix_spawnattr_setrlimit_np (posix_spawnattr_t *__attr,
+					 unsigned int __mask,
+					 const struct rlimit *__limits)
+     __THROW __nonnull ((1));
+
+/* Return the resource limits in the attribute structure.  */
+extern int posix_spawnattr_getrlimit_np (const posix_spawnattr_t *
+					 __restrict __attr,
+					 unsigned int *__restrict __mask,
+					 const struct rlimit **__restrict
+					 __limits)
+     __THROW __nonnull ((1, 2, 3));
+
+/* A stage of a pipeline for posix_spawn_pipeline_np.  */
+struct posix_spawn_stage
+{
+  const char *path;		/* Program to execute, or NULL.  */
+  const char *file;		/* If not NULL, searched for if PATH is NULL
+				   or does not exist: on the PATH in the
+				   stage's environment if PATH is NULL, on
+				   the caller's otherwise.  */
+  char *const *argv;
+  char *const *envp;		/* Environment, or NULL for the one passed
+				   to posix_spawn_pipeline_np.  */
+  int dup_stderr;		/* Nonzero to send stderr to stdout.  */
+  const char *builtin_output;	/* If not NULL, the caller ran the stage
+				   and left its output in this file: the
+				   stage is not spawned, its input is not
+				   read, and the next stage reads the
+				   file.  */
+
+  /* Set by posix_spawn_pipeline_np.  */
+  pid_t pid;			/* 0 if the stage could not be spawned,
+				   unless POSIX_SPAWN_SETPARENT is set.  */
+  int pidfd;			/* -1 unless POSIX_SPAWN_PIDFD is set.  */
+  int err;			/* Why the stage could not be spawned.  */
+  int searched;			/* Nonzero if FILE was searched for.  */
+};
+
+/* A pipeline for posix_spawn_pipeline_np.  */
+struct posix_spawn_pipeline
+{
+  struct posix_spawn_stage *stages;
+  int nstages;
+  const char *input;		/* Stdin of the first stage, or NULL.  */
+  const char *output;		/* Stdout of the last stage, or NULL.  */
+  int output_append;		/* Nonzero to append to OUTPUT.  */
+  mode_t output_mode;		/* Mode if OUTPUT is created.  */
+  int nworkers;			/* Threads that may spawn stages at the
+				   same time, counting the caller.  */
+  void (*stage_hook) (struct posix_spawn_pipeline *__pipeline,
+		      int __stage, int __begin);
+				/* If not NULL, called by the thread that
+				   spawns stage STAGE right before it
+				   does, with BEGIN nonzero, and right
+				   after, with BEGIN zero; it may set the
+				   stage's ENVP in between.  */
+  void *hook_arg;		/* For STAGE_HOOK.  */
+};
+
+/* Spawn the stages of PIPELINE, connected by pipes, with the attributes
+   in *ATTRP.  All stages join one process group: the one set with
+   posix_spawnattr_setpgroup, or else a new group led by the first stage
+   spawned, which alone is made the foreground process group if
+   POSIX_SPAWN_TCSETPGROUP is set.  Each stage starts with only file
+   descriptors 0 to 2 open.  Once the leader is spawned, the other
+   stages are spawned by up to NWORKERS threads at the same time.
+   Returns the error of the first stage that could not be spawned, or 0;
+   the other stages are spawned anyway.  Stages with a BUILTIN_OUTPUT
+   are skipped, and are left with a pid of 0.  With POSIX_SPAWN_SETPARENT the
+   stages are children of the caller's parent, and a stage that failed
+   to exec keeps its pid and pidfd, since only that parent can reap it.  */
+extern int posix_spawn_pipeline_np (struct posix_spawn_pipeline *__pipeline,
+				    const posix_spawnattr_t *__restrict
+				    __attrp,
+				    char *const __envp[])
+     __nonnull ((1));
+
+/* Record that the process may install a handler for signal SIG.  Once
+   any signal has been recorded, spawned children reset only recorded
+   signals to SIG_DFL before they exec, so every handler the process
+   installs must be recorded.  */
+extern int posix_spawn_addhandled_np (int __sig) __THROW;
 #endif
 
 /* Initialize data structure for file attribute for `spawn' call.  */
@@ -227,6 +396,13 @@ extern int posix_spawn_file_actions_addchdir_np (posix_spawn_file_actions_t *
 extern int posix_spawn_file_actions_addfchdir_np (posix_spawn_file_actions_t *,
 						  int __fd)
      __THROW __nonnull ((1));
+
+/* Add an action to close all file descriptors above or equal to FROM
+   during spawn.  This affects the subsequent file actions.  */
+extern int
+posix_spawn_file_actions_addclosefrom_np (posix_spawn_file_actions_t *,
+					  int __from)
+     __THROW __nonnull ((1));
 #endif
 
 __END_DECLS
@@ -32,6 +32,7 @@ struct __spawn_action
     spawn_do_open,
     spawn_do_chdir,
     spawn_do_fchdir,
+    spawn_do_closefrom,
   } tag;
 
   union
@@ -60,11 +61,18 @@ struct __spawn_action
     {
       int fd;
     } fchdir_action;
+    struct
+    {
+      int from;
+    } closefrom_action;
   } action;
 };
 
 #define SPAWN_XFLAGS_USE_PATH	0x1
 #define SPAWN_XFLAGS_TRY_SHELL	0x2
+#define SPAWN_XFLAGS_ENV_PATH	0x4	/* With SPAWN_XFLAGS_USE_PATH, search
+					   the PATH in envp, not the
+					   caller's.  */
 
 extern int __posix_spawn_file_actions_realloc (posix_spawn_file_actions_t *
 					       file_actions);
@@ -74,8 +82,20 @@ extern int __spawni (pid_t *pid, const char *path,
 		     const posix_spawnattr_t *attrp, char *const argv[],
 		     char *const envp[], int xflags);
 
+extern int __spawni_fallback (pid_t *pid, const char *path, const char *file,
+			      const posix_spawn_file_actions_t *file_actions,
+			      const posix_spawnattr_t *attrp,
+			      char *const argv[], char *const envp[],
+			      bool *searched);
+
 /* Return true if FD falls into the range valid for file descriptors.
    The check in this form is mandated by POSIX.  */
 bool __spawn_valid_fd (int fd);
 
+/* The signals registered with posix_spawn_addhandled_np.  Unless
+   __spawn_handled_signals_tracked is set, every signal may have a
+   handler.  */
+extern sigset_t __spawn_handled_signals;
+extern bool __spawn_handled_signals_tracked;
+
 #endif /* _SPAWN_INT_H */
@@ -0,0 +1,343 @@
+/* Spawn all stages of a pipeline.
+   Copyright (C) 2021 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <https://www.gnu.org/licenses/>.  */
+
+#define _GNU_SOURCE 1
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "spawn_int.h"
+
+/* Most file actions a stage needs: open and dup2 for stdin and stdout,
+   dup2 for stderr, and closefrom.  */
+#define STAGE_MAX_ACTIONS 6
+
+/* Most threads that spawn the stages of one pipeline, counting the
+   caller.  */
+#define PIPELINE_MAX_WORKERS 8
+
+/* The state shared by the threads spawning one pipeline.  */
+struct pipeline_run
+{
+  struct posix_spawn_pipeline *pipeline;
+  int (*pipes)[2];
+  posix_spawnattr_t attr;	/* For all stages but the leader.  */
+  char *const *envp;
+  atomic_int next;		/* Next stage to be claimed.  */
+  int finished;			/* Stages spawned or failed, under pool.lock.  */
+  int users;			/* Workers still using the run.  */
+};
+
+static void
+add_action (posix_spawn_file_actions_t *fa, struct __spawn_action action)
+{
+  fa->__actions[fa->__used++] = action;
+}
+
+/* Spawn stage I of RUN's pipeline with ATTR, and close the parent's
+   ends of its pipes.  Returns 0 or an error code.  */
+static int
+spawn_stage (struct pipeline_run *run, int i, posix_spawnattr_t *attr)
+{
+  struct posix_spawn_pipeline *pipeline = run->pipeline;
+  struct posix_spawn_stage *stage = &pipeline->stages[i];
+  int nstages = pipeline->nstages;
+  int (*pipes)[2] = run->pipes;
+
+  struct __spawn_action actions[STAGE_MAX_ACTIONS];
+  posix_spawn_file_actions_t fa =
+    {
+      .__allocated = STAGE_MAX_ACTIONS,
+      .__actions = actions
+    };
+  if (i == 0 && pipeline->input != NULL)
+    add_action (&fa, (struct __spawn_action) {
+	.tag = spawn_do_open,
+	.action.open_action = { STDIN_FILENO, (char *) pipeline->input,
+				O_RDONLY, 0 } });
+  if (i > 0 && pipeline->stages[i - 1].builtin_output != NULL)
+    add_action (&fa, (struct __spawn_action) {
+	.tag = spawn_do_open,
+	.action.open_action = { STDIN_FILENO,
+				(char *) pipeline->stages[i - 1].builtin_output,
+				O_RDONLY, 0 } });
+  else if (i > 0)
+    add_action (&fa, (struct __spawn_action) {
+	.tag = spawn_do_dup2,
+	.action.dup2_action = { pipes[i - 1][0], STDIN_FILENO } });
+  if (i == nstages - 1 && pipeline->output != NULL)
+    add_action (&fa, (struct __spawn_action) {
+	.tag = spawn_do_open,
+	.action.open_action = { STDOUT_FILENO, (char *) pipeline->output,
+				O_WRONLY | O_CREAT
+				| (pipeline->output_append ? O_APPEND : O_TRUNC),
+				pipeline->output_mode } });
+  if (i < nstages - 1)
+    add_action (&fa, (struct __spawn_action) {
+	.tag = spawn_do_dup2,
+	.action.dup2_action = { pipes[i][1], STDOUT_FILENO } });
+  if (stage->dup_stderr)
+    add_action (&fa, (struct __spawn_action) {
+	.tag = spawn_do_dup2,
+	.action.dup2_action = { STDOUT_FILENO, STDERR_FILENO } });
+  add_action (&fa, (struct __spawn_action) {
+      .tag = spawn_do_closefrom,
+      .action.closefrom_action = { STDERR_FILENO + 1 } });
+
+  stage->pid = 0;
+  stage->pidfd = -1;
+  stage->searched = 0;
+  attr->__pidfd = &stage->pidfd;
+
+  if (pipeline->stage_hook != NULL)
+    pipeline->stage_hook (pipeline, i, 1);
+  char *const *envp = stage->envp != NULL ? stage->envp : run->envp;
+  int rc = ENOENT;
+  if (stage->builtin_output != NULL)
+    rc = 0;
+  else if (stage->path != NULL)
+    {
+      bool searched;
+      rc = __spawni_fallback (&stage->pid, stage->path, stage->file, &fa,
+			      attr, stage->argv, envp, &searched);
+      stage->searched = searched;
+    }
+  else if (stage->file != NULL)
+    {
+      stage->searched = 1;
+      rc = __spawni (&stage->pid, stage->file, &fa, attr, stage->argv,
+		     envp, SPAWN_XFLAGS_USE_PATH | SPAWN_XFLAGS_ENV_PATH);
+    }
+  stage->err = rc;
+  if (pipeline->stage_hook != NULL)
+    pipeline->stage_hook (pipeline, i, 0);
+
+  /* The stage has its ends of the pipes now.  Each end belongs to one
+     stage, so threads never close an fd another one still uses.  A
+     builtin's input is closed unread, so the previous stage gets
+     SIGPIPE as it would from a process that exits without reading.  */
+  if (i > 0)
+    close (pipes[i - 1][0]);
+  if (i < nstages - 1)
+    close (pipes[i][1]);
+  return rc;
+}
+
+/* Threads that spawn stages for posix_spawn_pipeline_np.  They are
+   started on first use and wait for the next pipeline.  One pipeline at
+   a time is handed to them.  */
+static struct
+{
+  pthread_mutex_t lock;
+  pthread_cond_t work;		/* A new run was posted.  */
+  pthread_cond_t done;		/* A run finished, or a worker left it.  */
+  int nthreads;
+  unsigned generation;		/* Incremented for each run posted.  */
+  struct pipeline_run *run;	/* The run being spawned, or NULL.  */
+} pool =
+  {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+  };
+
+/* Claim and spawn stages of RUN until none are left.  */
+static void
+run_stages (struct pipeline_run *run)
+{
+  int i;
+  posix_spawnattr_t attr = run->attr;
+  while ((i = atomic_fetch_add (&run->next, 1)) < run->pipeline->nstages)
+    {
+      spawn_stage (run, i, &attr);
+      pthread_mutex_lock (&pool.lock);
+      if (++run->finished == run->pipeline->nstages)
+	pthread_cond_broadcast (&pool.done);
+      pthread_mutex_unlock (&pool.lock);
+    }
+}
+
+/* ARG is the generation before the worker was started, so a worker
+   started for a run takes part in it.  */
+static void *
+pool_worker (void *arg)
+{
+  unsigned seen = (uintptr_t) arg;
+  pthread_mutex_lock (&pool.lock);
+  for (;;)
+    {
+      while (pool.generation == seen)
+	pthread_cond_wait (&pool.work, &pool.lock);
+      seen = pool.generation;
+      struct pipeline_run *run = pool.run;
+      if (run == NULL)
+	continue;
+      run->users++;
+      pthread_mutex_unlock (&pool.lock);
+
+      run_stages (run);
+
+      pthread_mutex_lock (&pool.lock);
+      if (--run->users == 0)
+	pthread_cond_broadcast (&pool.done);
+    }
+  return NULL;
+}
+
+/* A forked child has none of the threads.  */
+static void
+pool_reset_child (void)
+{
+  pthread_mutex_init (&pool.lock, NULL);
+  pool.nthreads = 0;
+  pool.run = NULL;
+}
+
+/* Start workers until there are NTHREADS, with pool.lock held.  They
+   block all signals, so signals (SIGCHLD in particular) still go to the
+   threads that expect them.  */
+static void
+pool_grow (int nthreads)
+{
+  if (pool.nthreads == 0
+      && pthread_atfork (NULL, NULL, pool_reset_child) != 0)
+    return;
+
+  sigset_t all, old;
+  sigfillset (&all);
+  pthread_sigmask (SIG_SETMASK, &all, &old);
+  pthread_attr_t tattr;
+  pthread_attr_init (&tattr);
+  pthread_attr_setdetachstate (&tattr, PTHREAD_CREATE_DETACHED);
+  pthread_attr_setstacksize (&tattr, 64 * 1024);
+  while (pool.nthreads < nthreads)
+    {
+      pthread_t thread;
+      if (pthread_create (&thread, &tattr, pool_worker,
+			  (void *) (uintptr_t) pool.generation) != 0)
+	break;
+      pool.nthreads++;
+    }
+  pthread_attr_destroy (&tattr);
+  pthread_sigmask (SIG_SETMASK, &old, NULL);
+}
+
+int
+posix_spawn_pipeline_np (struct posix_spawn_pipeline *pipeline,
+			 const posix_spawnattr_t *attrp, char *const envp[])
+{
+  int nstages = pipeline->nstages;
+  if (nstages <= 0)
+    return EINVAL;
+
+  /* Pipe I connects stage I to stage I + 1.  All pipes are made up front
+     so a failure leaves no stage running.  */
+  int (*pipes)[2] = NULL;
+  if (nstages > 1)
+    {
+      pipes = malloc ((nstages - 1) * sizeof *pipes);
+      if (pipes == NULL)
+	return ENOMEM;
+      for (int i = 0; i < nstages - 1; i++)
+	if (pipe2 (pipes[i], O_CLOEXEC) != 0)
+	  {
+	    int ec = errno;
+	    while (i-- > 0)
+	      {
+		close (pipes[i][0]);
+		close (pipes[i][1]);
+	      }
+	    free (pipes);
+	    return ec;
+	  }
+    }
+
+  struct pipeline_run run =
+    {
+      .pipeline = pipeline,
+      .pipes = pipes,
+      .attr = attrp ? *attrp : (posix_spawnattr_t) { 0 },
+      .envp = envp,
+    };
+
+  /* Every stage joins the group of the first one spawned, the leader,
+     which alone takes the terminal.  The leader is spawned before the
+     other stages, so the group exists when they join it.  */
+  posix_spawnattr_t attr = run.attr;
+  attr.__flags |= POSIX_SPAWN_SETPGROUP;
+  if ((run.attr.__flags & POSIX_SPAWN_SETPGROUP) == 0)
+    attr.__pgrp = 0;
+  int leader = 0;
+  while (leader < nstages && (spawn_stage (&run, leader, &attr) != 0
+			      || pipeline->stages[leader].builtin_output != NULL))
+    leader++;
+  run.attr.__flags = attr.__flags & ~POSIX_SPAWN_TCSETPGROUP;
+  run.attr.__pgrp = attr.__pgrp != 0 || leader == nstages
+		    ? attr.__pgrp : pipeline->stages[leader].pid;
+  run.finished = leader < nstages ? leader + 1 : nstages;
+  atomic_init (&run.next, run.finished);
+
+  int nworkers = pipeline->nworkers;
+  if (nworkers > PIPELINE_MAX_WORKERS)
+    nworkers = PIPELINE_MAX_WORKERS;
+  if (nworkers > nstages - run.finished)
+    nworkers = nstages - run.finished;
+  if (nworkers > 1)
+    {
+      /* Workers block all signals; give their children the caller's
+	 mask instead.  */
+      if ((run.attr.__flags & POSIX_SPAWN_SETSIGMASK) == 0)
+	{
+	  pthread_sigmask (SIG_BLOCK, NULL, &run.attr.__ss);
+	  run.attr.__flags |= POSIX_SPAWN_SETSIGMASK;
+	}
+
+      pthread_mutex_lock (&pool.lock);
+      while (pool.run != NULL)
+	pthread_cond_wait (&pool.done, &pool.lock);
+      pool_grow (nworkers - 1);
+      pool.run = &run;
+      pool.generation++;
+      pthread_cond_broadcast (&pool.work);
+      pthread_mutex_unlock (&pool.lock);
+
+      run_stages (&run);
+
+      pthread_mutex_lock (&pool.lock);
+      while (run.finished < nstages || run.users > 0)
+	pthread_cond_wait (&pool.done, &pool.lock);
+      pool.run = NULL;
+      pthread_cond_broadcast (&pool.done);
+      pthread_mutex_unlock (&pool.lock);
+    }
+  else
+    run_stages (&run);
+
+  free (pipes);
+
+  for (int i = 0; i < nstages; i++)
+    if (pipeline->stages[i].err != 0)
+      return pipeline->stages[i].err;
+  return 0;
+}
@@ -0,0 +1,37 @@
+/* Record the signals the process installs handlers for.
+   Copyright (C) 2021 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <https://www.gnu.org/licenses/>.  */
+
+#include <errno.h>
+#include <signal.h>
+#include "spawn_int.h"
+
+sigset_t __spawn_handled_signals;
+bool __spawn_handled_signals_tracked;
+
+int
+posix_spawn_addhandled_np (int sig)
+{
+  if (!__spawn_handled_signals_tracked)
+    {
+      sigemptyset (&__spawn_handled_signals);
+      __spawn_handled_signals_tracked = true;
+    }
+  if (sigaddset (&__spawn_handled_signals, sig) != 0)
+    return errno;
+  return 0;
+}
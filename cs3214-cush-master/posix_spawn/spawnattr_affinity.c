@@ -0,0 +1,54 @@
+/* Set and get the CPU affinity option.
+   Copyright (C) 2021 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <https://www.gnu.org/licenses/>.  */
+
+#define _GNU_SOURCE 1
+#include <errno.h>
+#include <spawn.h>
+#include <string.h>
+
+int
+posix_spawnattr_setaffinity_np (posix_spawnattr_t *attr, size_t cpusetsize,
+				const cpu_set_t *cpuset)
+{
+  if (cpusetsize == 0)
+    return EINVAL;
+  attr->__cpuset = cpuset;
+  attr->__cpusetsize = cpusetsize;
+  return 0;
+}
+
+int
+posix_spawnattr_getaffinity_np (const posix_spawnattr_t *attr,
+				size_t cpusetsize, cpu_set_t *cpuset)
+{
+  /* Like pthread_attr_getaffinity_np, fail if a CPU in the set does
+     not fit, and clear the rest of a larger set.  */
+  size_t size = attr->__cpuset != NULL ? attr->__cpusetsize : 0;
+  if (size > cpusetsize)
+    {
+      const char *p = (const char *) attr->__cpuset;
+      for (size_t i = cpusetsize; i < size; i++)
+	if (p[i] != 0)
+	  return EINVAL;
+      size = cpusetsize;
+    }
+  if (size > 0)
+    memcpy (cpuset, attr->__cpuset, size);
+  memset ((char *) cpuset + size, 0, cpusetsize - size);
+  return 0;
+}
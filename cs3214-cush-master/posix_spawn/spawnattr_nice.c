@@ -0,0 +1,38 @@
+/* Set and get the nice value option.
+   Copyright (C) 2021 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <https://www.gnu.org/licenses/>.  */
+
+#define _GNU_SOURCE 1
+#include <errno.h>
+#include <spawn.h>
+
+int
+posix_spawnattr_setnice_np (posix_spawnattr_t *attr, int nice)
+{
+  /* The range of setpriority for PRIO_PROCESS.  */
+  if (nice < -20 || nice > 19)
+    return EINVAL;
+  attr->__nice = nice;
+  return 0;
+}
+
+int
+posix_spawnattr_getnice_np (const posix_spawnattr_t *attr, int *nice)
+{
+  *nice = attr->__nice;
+  return 0;
+}
@@ -0,0 +1,42 @@
+/* Set and get the resource limits option.
+   Copyright (C) 2021 Free Software Foundation, Inc.
+   This file is part of the GNU C Library.
+
+   The GNU C Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   The GNU C Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with the GNU C Library; if not, see
+   <https://www.gnu.org/licenses/>.  */
+
+
+#define _GNU_SOURCE 1
+#include <errno.h>
+#include <spawn.h>
+
+int
+posix_spawnattr_setrlimit_np (posix_spawnattr_t *attr, unsigned int mask,
+			      const struct rlimit *limits)
+{
+  if (mask >= (1U << RLIM_NLIMITS) || (mask != 0 && limits == NULL))
+    return EINVAL;
+  attr->__rlimitmask = mask;
+  attr->__rlimits = limits;
+  return 0;
+}
+
+int
+posix_spawnattr_getrlimit_np (const posix_spawnattr_t *attr,
+			      unsigned int *mask, const struct rlimit **limits)
+{
+  *mask = attr->__rlimitmask;
+  *limits = attr->__rlimits;
+  return 0;
+}
@@ -28,7 +28,13 @@
 		   | POSIX_SPAWN_SETSCHEDULER				      \
 		   | POSIX_SPAWN_SETSID					      \
 		   | POSIX_SPAWN_USEVFORK				      \
-		   | POSIX_SPAWN_TCSETPGROUP)
+		   | POSIX_SPAWN_TCSETPGROUP				      \
+		   | POSIX_SPAWN_SETCGROUP				      \
+		   | POSIX_SPAWN_PIDFD					      \
+		   | POSIX_SPAWN_SETPARENT				      \
+		   | POSIX_SPAWN_SETAFFINITY				      \
+		   | POSIX_SPAWN_SETIOPRIO				      \
+		   | POSIX_SPAWN_SETNICE)
 
 /* Store flags in the attribute structure.  */
 int
@@ -39,7 +39,12 @@
 #include <sched.h>
 #include <signal.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/sched.h>
+#include <linux/ioprio.h>
 #define __pthread_setcancelstate pthread_setcancelstate
 #define __setpgid setpgid
 #define __getpgrp getpgrp
@@ -49,18 +54,25 @@
 #define __close_nocancel close
 #define __getrlimit64 getrlimit64
 #define __open_nocancel open
+#define __openat_nocancel openat
+#define __write_nocancel write
 #define __fcntl fcntl
 #define __fchdir fchdir
 #define __setsid setsid
 #define __waitpid waitpid
 #define __munmap munmap
 #define __mmap mmap
+#define __close_range close_range
+#define __getdtablesize getdtablesize
 #define __execve execve
 #define __chdir chdir
 #define __dup2 dup2
 #define __clone clone
 #define __sched_setparam sched_setparam
 #define __sched_setscheduler sched_setscheduler
+#define __sched_setaffinity sched_setaffinity
+#define __setpriority setpriority
+#define __setrlimit setrlimit
 #define __sigprocmask sigprocmask
 #define __sigismember sigismember
 #define __libc_sigaction sigaction
@@ -134,11 +146,47 @@ _Static_assert (sizeof (posix_spawnattr_t) == 336,
 #define SPAWN_ERROR	127
 
 #ifdef __ia64__
-# define CLONE(__fn, __stackbase, __stacksize, __flags, __args) \
-  __clone2 (__fn, __stackbase, __stacksize, __flags, __args, 0, 0, 0)
+# define CLONE(__fn, __stackbase, __stacksize, __flags, __args, __ptid) \
+  __clone2 (__fn, __stackbase, __stacksize, __flags, __args, __ptid, 0, 0)
 #else
-# define CLONE(__fn, __stack, __stacksize, __flags, __args) \
-  __clone (__fn, __stack, __flags, __args)
+# define CLONE(__fn, __stack, __stacksize, __flags, __args, __ptid) \
+  __clone (__fn, __stack, __flags, __args, __ptid)
+#endif
+
+/* clone3 can create the pidfd and place the child into its cgroup as
+   part of the clone.  It has no libc wrapper, and since the child
+   returns from the system call on its new stack, the child side has to
+   be written in assembly: it calls FN (ARG) and exits with its return
+   value.  __spawn_clone3 returns the child's pid, or -errno.  */
+#if defined __x86_64__ && defined SYS_clone3 && defined CLONE_INTO_CGROUP
+# define HAVE_CLONE3 1
+# define __SPAWN_STR1(x) #x
+# define __SPAWN_STR(x) __SPAWN_STR1 (x)
+
+extern long __spawn_clone3 (struct clone_args *cl_args, size_t size,
+			    int (*fn) (void *), void *arg)
+     __attribute__ ((visibility ("hidden")));
+
+__asm__ (".text\n"
+	 ".globl __spawn_clone3\n"
+	 ".hidden __spawn_clone3\n"
+	 ".type __spawn_clone3, @function\n"
+	 "__spawn_clone3:\n"
+	 "	mov %rcx, %r8\n"		/* ARG survives the syscall.  */
+	 "	mov $" __SPAWN_STR (SYS_clone3) ", %eax\n"
+	 "	syscall\n"
+	 "	test %rax, %rax\n"
+	 "	jz 1f\n"
+	 "	ret\n"
+	 "1:	xor %ebp, %ebp\n"		/* Outermost frame.  */
+	 "	and $-16, %rsp\n"
+	 "	mov %r8, %rdi\n"
+	 "	call *%rdx\n"			/* FN, also kept by the child.  */
+	 "	mov %rax, %rdi\n"
+	 "	mov $" __SPAWN_STR (SYS_exit) ", %eax\n"
+	 "	syscall\n"
+	 "	hlt\n"
+	 ".size __spawn_clone3, .-__spawn_clone3\n");
 #endif
 
 /* Since ia64 wants the stackbase w/clone2, re-use the grows-up macro.  */
@@ -160,16 +208,86 @@ struct posix_spawn_args
   ptrdiff_t argc;
   char *const *envp;
   int xflags;
+  const char *fallback;
+  bool searched;
+  bool in_cgroup;
   int err;
 };
 
-/* Older version requires that shell script without shebang definition
-   to be called explicitly using /bin/sh (_PATH_BSHELL).  */
+/* Child stacks are not unmapped after a spawn but kept for the next
+   one, so a spawn does not pay for an mmap, an munmap and the page
+   faults on the fresh stack.  A pool stack is sized, like any other,
+   from the argument vector it is first needed for, and populated when
+   it is created; a spawn that needs more replaces it with a larger
+   one.  Stacks larger than STACK_POOL_MAX_STACK_SIZE are not kept.
+   Each slot is claimed with a compare-and-swap, so concurrent spawns
+   from several threads use different stacks, and spawns beyond the
+   number of slots get a stack from mmap.  */
+#define STACK_POOL_SLOTS 8
+#define STACK_POOL_MAX_STACK_SIZE (1024 * 1024)
+
+static struct
+{
+  atomic_int busy;
+  void *stack;
+  size_t size;
+} stack_pool[STACK_POOL_SLOTS];
+
+/* Return a stack of at least *STACK_SIZE bytes, or MAP_FAILED.  Sets
+   *STACK_SIZE to its actual size and *SLOT to its pool slot or -1.  */
+static void *
+stack_pool_get (size_t *stack_size, int prot, int *slot)
+{
+  *slot = -1;
+  if (*stack_size <= STACK_POOL_MAX_STACK_SIZE)
+    for (int i = 0; i < STACK_POOL_SLOTS; i++)
+      {
+	int expected = 0;
+	if (!atomic_compare_exchange_strong (&stack_pool[i].busy, &expected, 1))
+	  continue;
+	if (stack_pool[i].stack != NULL && stack_pool[i].size < *stack_size)
+	  {
+	    __munmap (stack_pool[i].stack, stack_pool[i].size);
+	    stack_pool[i].stack = NULL;
+	  }
+	if (stack_pool[i].stack == NULL)
+	  {
+	    void *stack = __mmap (NULL, *stack_size, prot,
+				  MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK
+				  | MAP_POPULATE, -1, 0);
+	    if (stack == MAP_FAILED)
+	      {
+		atomic_store (&stack_pool[i].busy, 0);
+		break;
+	      }
+	    stack_pool[i].stack = stack;
+	    stack_pool[i].size = *stack_size;
+	  }
+	*slot = i;
+	*stack_size = stack_pool[i].size;
+	return stack_pool[i].stack;
+      }
+
+  return __mmap (NULL, *stack_size, prot,
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+}
+
+/* Give back a stack obtained from stack_pool_get.  */
+static void
+stack_pool_put (void *stack, size_t stack_size, int slot)
+{
+  if (slot == -1)
+    __munmap (stack, stack_size);
+  else
+    atomic_store (&stack_pool[slot].busy, 0);
+}
+
+/* Run a shell script without shebang definition with /bin/sh
+   (_PATH_BSHELL), as shells do, if SPAWN_XFLAGS_TRY_SHELL is set.  */
 static void
 maybe_script_execute (struct posix_spawn_args *args)
 {
-  if (false // SHLIB_COMPAT (libc, GLIBC_2_2, GLIBC_2_15)
-      && (args->xflags & SPAWN_XFLAGS_TRY_SHELL) && errno == ENOEXEC)
+  if ((args->xflags & SPAWN_XFLAGS_TRY_SHELL) && errno == ENOEXEC)
     {
       char *const *argv = args->argv;
       ptrdiff_t argc = args->argc;
@@ -179,7 +297,7 @@ maybe_script_execute (struct posix_spawn_args *args)
       new_argv[0] = (char *) _PATH_BSHELL;
       new_argv[1] = (char *) args->file;
       if (argc > 1)
-	memcpy (new_argv + 2, argv + 1, argc * sizeof (char *));
+	memcpy (new_argv + 2, argv + 1, (argc - 1) * sizeof (char *));
       else
 	new_argv[2] = NULL;
 
@@ -188,6 +306,75 @@ maybe_script_execute (struct posix_spawn_args *args)
     }
 }
 
+/* Like execvpe, but search the PATH in ENVP rather than the caller's,
+   as a shell does for a command with an assignment to PATH in front of
+   it.  A file that turns out to be a script without shebang definition
+   is run with /bin/sh, as execvpe does.  */
+static int
+__execvpe_envpath (const char *file, char *const argv[], char *const envp[])
+{
+  if (strchr (file, '/') != NULL)
+    return __execve (file, argv, envp);
+
+  const char *path = NULL;
+  for (char *const *env = envp; *env != NULL; env++)
+    if (strncmp (*env, "PATH=", 5) == 0)
+      path = *env + 5;
+  if (path == NULL)
+    path = "/bin:/usr/bin";
+
+  size_t file_len = strlen (file) + 1;
+  char buffer[PATH_MAX];
+  bool got_eacces = false;
+  const char *subp;
+  for (const char *p = path; ; p = subp + 1)
+    {
+      subp = strchrnul (p, ':');
+      /* An empty element stands for the current directory.  */
+      if ((subp - p) + 1 + file_len <= sizeof buffer)
+	{
+	  char *pend = mempcpy (buffer, p, subp - p);
+	  *pend = '/';
+	  memcpy (pend + (p < subp), file, file_len);
+
+	  __execve (buffer, argv, envp);
+	  switch (errno)
+	    {
+	    case EACCES:
+	      got_eacces = true;
+	      /* Fall through.  */
+	    case ENOENT:
+	    case ESTALE:
+	    case ENOTDIR:
+	    case ENODEV:
+	    case ETIMEDOUT:
+	      break;
+	    case ENOEXEC:
+	      {
+		ptrdiff_t argc = 0;
+		while (argv[argc++] != NULL)
+		  ;
+		char *new_argv[argc + 2];
+		new_argv[0] = (char *) _PATH_BSHELL;
+		new_argv[1] = buffer;
+		memcpy (new_argv + 2, argv + 1, (argc - 1) * sizeof (char *));
+		new_argv[argc + 1] = NULL;
+		__execve (new_argv[0], new_argv, envp);
+		return -1;
+	      }
+	    default:
+	      return -1;
+	    }
+	}
+      if (*subp == '\0')
+	break;
+    }
+
+  if (got_eacces)
+    errno = EACCES;
+  return -1;
+}
+
 /* Function used in the clone call to setup the signals mask, posix_spawn
    attributes, and file actions.  It run on its own stack (provided by the
    posix_spawn call).  */
@@ -200,15 +387,16 @@ __spawni_child (void *arguments)
 
   /* The child must ensure that no signal handler are enabled because it shared
      memory with parent, so the signal disposition must be either SIG_DFL or
-     SIG_IGN.  It does by iterating over all signals and although it could
-     possibly be more optimized (by tracking which signal potentially have a
-     signal handler), it might requires system specific solutions (since the
-     sigset_t data type can be very different on different architectures).  */
+     SIG_IGN.  If the process records the signals it installs handlers for
+     (see posix_spawn_addhandled_np), only those are checked; otherwise it
+     iterates over all signals.  Signals that are already SIG_DFL or SIG_IGN
+     are left alone.  */
   struct sigaction sa;
   memset (&sa, '\0', sizeof (sa));
 
   sigset_t hset;
   __sigprocmask (SIG_BLOCK, 0, &hset);
+  bool tracked = __spawn_handled_signals_tracked;
   for (int sig = 1; sig < _NSIG; ++sig)
     {
       if ((attr->__flags & POSIX_SPAWN_SETSIGDEF)
@@ -216,14 +404,15 @@ __spawni_child (void *arguments)
 	{
 	  sa.sa_handler = SIG_DFL;
 	}
-      else if (__sigismember (&hset, sig))
+      else if (__sigismember (&hset, sig)
+	       && (!tracked || __sigismember (&__spawn_handled_signals, sig)))
 	{
 	  if (__is_internal_signal (sig))
 	    sa.sa_handler = SIG_IGN;
 	  else
 	    {
 	      __libc_sigaction (sig, 0, &sa);
-	      if (sa.sa_handler == SIG_IGN)
+	      if (sa.sa_handler == SIG_IGN || sa.sa_handler == SIG_DFL)
 		continue;
 	      sa.sa_handler = SIG_DFL;
 	    }
@@ -249,6 +438,19 @@ __spawni_child (void *arguments)
     }
 #endif
 
+  /* Set the nice value, the CPUs to run on, and the I/O priority.  */
+  if ((attr->__flags & POSIX_SPAWN_SETNICE) != 0
+      && __setpriority (PRIO_PROCESS, 0, attr->__nice) == -1)
+    goto fail;
+
+  if ((attr->__flags & POSIX_SPAWN_SETAFFINITY) != 0
+      && __sched_setaffinity (0, attr->__cpusetsize, attr->__cpuset) == -1)
+    goto fail;
+
+  if ((attr->__flags & POSIX_SPAWN_SETIOPRIO) != 0
+      && syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, attr->__ioprio) == -1)
+    goto fail;
+
   if ((attr->__flags & POSIX_SPAWN_SETSID) != 0
       && __setsid () < 0)
     goto fail;
@@ -269,6 +471,19 @@ __spawni_child (void *arguments)
 	goto fail;
     }
 
+  /* Move to the cgroup, unless clone3 already placed the child there.  */
+  if ((attr->__flags & POSIX_SPAWN_SETCGROUP) != 0 && !args->in_cgroup)
+    {
+      int fd = __openat_nocancel (attr->__cgroup, "cgroup.procs",
+				  O_WRONLY | O_CLOEXEC);
+      if (fd == -1)
+	goto fail;
+      ssize_t n = __write_nocancel (fd, "0", 1);
+      __close_nocancel (fd);
+      if (n != 1)
+	goto fail;
+    }
+
   /* Set the effective user and group IDs.  */
   if ((attr->__flags & POSIX_SPAWN_RESETIDS) != 0
       && (local_seteuid (__getuid ()) != 0
@@ -365,10 +580,34 @@ __spawni_child (void *arguments)
 	      if (__fchdir (action->action.fchdir_action.fd) != 0)
 		goto fail;
 	      break;
+
+	    case spawn_do_closefrom:
+	      {
+		int lowfd = action->action.closefrom_action.from;
+		if (__close_range (lowfd, ~0U, 0) != 0)
+		  {
+		    /* Kernels before 5.9 lack close_range.  */
+		    if (errno != ENOSYS)
+		      goto fail;
+		    int maxfd = __getdtablesize ();
+		    for (int fd = lowfd; fd < maxfd; fd++)
+		      __close_nocancel (fd);
+		  }
+	      }
+	      break;
 	    }
 	}
     }
 
+  /* Set the resource limits last, so that a low RLIMIT_NOFILE or
+     RLIMIT_FSIZE does not get in the way of the file actions.  */
+  for (unsigned int mask = attr->__rlimitmask; mask != 0; mask &= mask - 1)
+    {
+      int resource = __builtin_ctz (mask);
+      if (__setrlimit (resource, &attr->__rlimits[resource]) != 0)
+	goto fail;
+    }
+
   /* Set the initial signal mask of the child if POSIX_SPAWN_SETSIGMASK
      is set, otherwise restore the previous one.  */
   __sigprocmask (SIG_SETMASK, (attr->__flags & POSIX_SPAWN_SETSIGMASK)
@@ -376,9 +615,16 @@ __spawni_child (void *arguments)
 
   args->exec (args->file, args->argv, args->envp);
 
-  /* This is compatibility function required to enable posix_spawn run
-     script without shebang definition for older posix_spawn versions
-     (2.15).  */
+  /* A cached path that went away is searched for on PATH by the same
+     child, so a stale cache entry does not cost a second spawn.  */
+  if (errno == ENOENT && args->fallback != NULL)
+    {
+      args->searched = true;
+      __execvpex (args->fallback, args->argv, args->envp);
+    }
+
+  /* Run a script without shebang definition with the shell.  A path
+     that was searched for was already tried by __execvpex.  */
   maybe_script_execute (args);
 
 fail:
@@ -398,7 +644,8 @@ __spawnix (pid_t * pid, const char *file,
 	   const posix_spawn_file_actions_t * file_actions,
 	   const posix_spawnattr_t * attrp, char *const argv[],
 	   char *const envp[], int xflags,
-	   int (*exec) (const char *, char *const *, char *const *))
+	   int (*exec) (const char *, char *const *, char *const *),
+	   const char *fallback, bool *searched)
 {
   pid_t new_pid;
   struct posix_spawn_args args;
@@ -432,8 +679,8 @@ __spawnix (pid_t * pid, const char *file,
      extra pages won't actually be allocated unless they get used.  */
   argv_size += (32 * 1024);
   size_t stack_size = ALIGN_UP (argv_size, GLRO(dl_pagesize));
-  void *stack = __mmap (NULL, stack_size, prot,
-			MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+  int stack_slot;
+  void *stack = stack_pool_get (&stack_size, prot, &stack_slot);
   if (__glibc_unlikely (stack == MAP_FAILED))
     return errno;
 
@@ -452,6 +699,9 @@ __spawnix (pid_t * pid, const char *file,
   args.argc = argc;
   args.envp = envp;
   args.xflags = xflags;
+  args.fallback = fallback;
+  args.searched = false;
+  args.in_cgroup = false;
 
   __libc_signal_block_all (&args.oldmask);
 
@@ -462,9 +712,56 @@ __spawnix (pid_t * pid, const char *file,
      Also since the calling thread execution will be suspend, there is not
      need for CLONE_SETTLS.  Although parent and child share the same TLS
      namespace, there will be no concurrent access for TLS variables (errno
-     for instance).  */
-  new_pid = CLONE (__spawni_child, STACK (stack, stack_size), stack_size,
-		   CLONE_VM | CLONE_VFORK | SIGCHLD, &args);
+     for instance).
+
+     If a pidfd or a cgroup is requested, clone3 is tried first, so that
+     the pidfd refers to the child from its creation and the child starts
+     out in the cgroup.  Without clone3, clone returns the pidfd and the
+     child moves itself into the cgroup.
+
+     With POSIX_SPAWN_SETPARENT the child is made a child of our parent
+     (CLONE_PARENT), which is then the one to reap it and to be told
+     when it stops.  */
+  bool want_parent = (args.attr->__flags & POSIX_SPAWN_SETPARENT) != 0;
+  bool want_pidfd = (args.attr->__flags & POSIX_SPAWN_PIDFD) != 0
+		    && args.attr->__pidfd != NULL;
+  bool want_cgroup = (args.attr->__flags & POSIX_SPAWN_SETCGROUP) != 0;
+  int pidfd = -1;
+  new_pid = -ENOSYS;
+#ifdef HAVE_CLONE3
+  if (want_pidfd || want_cgroup)
+    {
+      struct clone_args cl_args =
+	{
+	  .flags = CLONE_VM | CLONE_VFORK
+		   | (want_parent ? CLONE_PARENT : 0)
+		   | (want_pidfd ? CLONE_PIDFD : 0)
+		   | (want_cgroup ? CLONE_INTO_CGROUP : 0),
+	  .pidfd = (uintptr_t) &pidfd,
+	  /* clone3 wants no exit signal with CLONE_PARENT: the child gets
+	     ours.  */
+	  .exit_signal = want_parent ? 0 : SIGCHLD,
+	  .stack = (uintptr_t) stack,
+	  .stack_size = stack_size,
+	  .cgroup = want_cgroup ? args.attr->__cgroup : 0,
+	};
+      args.in_cgroup = want_cgroup;
+      new_pid = __spawn_clone3 (&cl_args, want_cgroup ? CLONE_ARGS_SIZE_VER2
+						       : CLONE_ARGS_SIZE_VER0,
+				__spawni_child, &args);
+    }
+#endif
+  /* E2BIG means the kernel's clone3 predates CLONE_INTO_CGROUP.  */
+  if (new_pid == -ENOSYS || new_pid == -E2BIG)
+    {
+      args.in_cgroup = false;
+      new_pid = CLONE (__spawni_child, STACK (stack, stack_size), stack_size,
+		       CLONE_VM | CLONE_VFORK | SIGCHLD
+		       | (want_parent ? CLONE_PARENT : 0)
+		       | (want_pidfd ? CLONE_PIDFD : 0), &args, &pidfd);
+      if (new_pid == -1)
+	new_pid = -errno;
+    }
 
   /* It needs to collect the case where the auxiliary process was created
      but failed to execute the file (due either any preparation step or
@@ -478,7 +775,7 @@ __spawnix (pid_t * pid, const char *file,
 	 due a signal args.err will remain zeroed and it will be up to
 	 caller to actually collect it.  */
       ec = args.err;
-      if (ec > 0)
+      if (ec > 0 && !want_parent)
 	/* There still an unlikely case where the child is cancelled after
 	   setting args.err, due to a positive error value.  Also there is
 	   possible pid reuse race (where the kernel allocated the same pid
@@ -490,15 +787,26 @@ __spawnix (pid_t * pid, const char *file,
   else
     ec = -new_pid;
 
-  __munmap (stack, stack_size);
+  stack_pool_put (stack, stack_size, stack_slot);
 
-  if ((ec == 0) && (pid != NULL))
+  /* A child that failed is still reported if we can not reap it, so
+     that our parent knows to.  */
+  bool started = ec == 0 || (want_parent && new_pid > 0);
+  if (started && (pid != NULL))
     *pid = new_pid;
 
+  if (started && want_pidfd)
+    *args.attr->__pidfd = pidfd;
+  else if (pidfd != -1)
+    __close_nocancel (pidfd);
+
   __libc_signal_restore_set (&args.oldmask);
 
   __pthread_setcancelstate (state, NULL);
 
+  if (searched != NULL)
+    *searched = args.searched;
+
   return ec;
 }
 
@@ -512,6 +820,22 @@ __spawni (pid_t * pid, const char *file,
 {
   /* It uses __execvpex to avoid run ENOEXEC in non compatibility mode (it
      will be handled by maybe_script_execute).  */
-  return __spawnix (pid, file, acts, attrp, argv, envp, xflags,
-		    xflags & SPAWN_XFLAGS_USE_PATH ? __execvpex :__execve);
+  int (*exec) (const char *, char *const *, char *const *) = __execve;
+  if (xflags & SPAWN_XFLAGS_USE_PATH)
+    exec = xflags & SPAWN_XFLAGS_ENV_PATH ? __execvpe_envpath : __execvpex;
+  return __spawnix (pid, file, acts, attrp, argv, envp, xflags, exec,
+		    NULL, NULL);
+}
+
+/* Like __spawni for PATH, but if PATH does not exist search for FILE
+   on PATH instead, in the same child.  *SEARCHED tells whether FILE
+   was searched for.  */
+int
+__spawni_fallback (pid_t * pid, const char *path, const char *file,
+		   const posix_spawn_file_actions_t * acts,
+		   const posix_spawnattr_t * attrp, char *const argv[],
+		   char *const envp[], bool *searched)
+{
+  return __spawnix (pid, path, acts, attrp, argv, envp,
+		    SPAWN_XFLAGS_TRY_SHELL, __execve, file, searched);
 }
@@ -0,0 +1,62 @@
+#!/usr/bin/python
+#
+# Tests the batch job queue: jobs beyond the concurrency limit are
+# queued, shown by jobs, and started as running jobs complete.  Builtins
+# in queued pipelines run in the shell when the job starts.
+#
+import atexit, proc_check, time
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("batch -j 1")
+expect_prompt("Shell did not print expected prompt (2)")
+
+# the first job starts, the second waits for it
+start = time.time()
+sendline("batch sleep 0.7")
+(jobid1,) = expect_regex(r"\[(\d+)\] queued")
+expect_prompt("Shell did not print expected prompt (3)")
+sendline("batch sleep 0.7")
+(jobid2,) = expect_regex(r"\[(\d+)\] queued")
+expect_prompt("Shell did not print expected prompt (4)")
+
+sendline("jobs")
+expect_regex(r"\[" + jobid1 + r"\]\s+(Running)\s+sleep 0.7")
+expect_regex(r"\[" + jobid2 + r"\]\s+(Queued)\s+sleep 0.7")
+expect_prompt("Shell did not print expected prompt (5)")
+
+# a queued job can be removed before it starts
+sendline("batch sleep 0.7")
+(jobid3,) = expect_regex(r"\[(\d+)\] queued")
+expect_prompt("Shell did not print expected prompt (6)")
+run_builtin('kill', jobid3)
+expect_prompt("Shell did not print expected prompt (7)")
+
+# the second job runs once the first one is done
+sendline("wait")
+expect_prompt("Shell did not print expected prompt (8)")
+assert time.time() - start >= 1.4, 'batch jobs ran concurrently'
+
+sendline("jobs")
+expect_prompt("Shell did not print expected prompt (9)")
+assert "Queued" not in console.before and "Running" not in console.before, 'jobs left after wait'
+
+# builtins in a batch job run as they do in other pipelines
+sendline("batch -j 2 sleep 0.5")
+expect_regex(r"\[(\d+)\] queued")
+expect_prompt("Shell did not print expected prompt (10)")
+sendline("batch jobs | tr a-z A-Z")
+expect_regex(r"\[(\d+)\] queued")
+expect_prompt("Shell did not print expected prompt (11)")
+sendline("wait")
+expect_exact("RUNNING\t\tSLEEP 0.5)", "jobs in a batch pipeline did not run as a builtin")
+expect_prompt("Shell did not print expected prompt (12)")
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
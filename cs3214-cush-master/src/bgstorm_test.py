@@ -0,0 +1,44 @@
+#!/usr/bin/python
+#
+# Tests that many background jobs finishing at once are all
+# reported, that finished jobs are deleted right away rather
+# than after the next command, and that the processes of a killed
+# job are reaped without a message once the job is gone.
+#
+import atexit, proc_check, time
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+njobs = 50
+sendline(" ".join(["sleep 0.5 &"] * njobs))
+expect_prompt("Shell did not print expected prompt (2)")
+
+# every job is reported once
+for i in range(njobs):
+    expect_regex(r"\[\d+\]\s+(Done)\s+sleep 0.5")
+
+# and is gone without running another command first
+time.sleep(0.5)
+sendline("jobs")
+expect_prompt("Shell did not print expected prompt (3)")
+assert "sleep" not in console.before, 'finished jobs were not deleted'
+
+sendline("sleep 30 | sleep 30 &")
+(jobid, pid) = parse_bg_status()
+expect_prompt("Shell did not print expected prompt (4)")
+run_builtin('kill', jobid)
+expect_prompt("Shell did not print expected prompt (5)")
+time.sleep(0.5)
+sendline("echo reaped")
+expect_exact("reaped\r\n", "shell did not run a command after kill")
+assert "NOT FOUND" not in console.before, 'reaping a deleted job printed a message'
+expect_prompt("Shell did not print expected prompt (6)")
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,301 @@
+/*
+ * Per-job cgroup v2 support.
+ */
+#define _GNU_SOURCE 1
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "cgroup_support.h"
+#include "utils.h"
+
+static char *orig_path;     /* the cgroup the shell started in */
+static char *base_path;     /* <orig_path>/cush.<pid>[.<n>] */
+static int base_fd = -1;    /* holds the lock on base_path while the shell lives */
+static unsigned next_job_cgroup;
+
+/* Job cgroups that could not be removed yet */
+static char **stale_paths;
+static int num_stale_paths;
+
+/* Return the mount point of the cgroup v2 hierarchy, or NULL */
+static char *
+find_cgroup2_mount(void)
+{
+    FILE *f = fopen("/proc/self/mountinfo", "r");
+    if (f == NULL)
+        return NULL;
+
+    char *line = NULL, *mount = NULL;
+    size_t size = 0;
+    while (mount == NULL && getline(&line, &size, f) != -1) {
+        char root[PATH_MAX], mountpoint[PATH_MAX];
+        char *sep = strstr(line, " - ");
+        if (sep == NULL || strncmp(sep, " - cgroup2 ", 11) != 0)
+            continue;
+        if (sscanf(line, "%*d %*d %*s %s %s", root, mountpoint) == 2
+                && strcmp(root, "/") == 0)
+            mount = strdup(mountpoint);
+    }
+    free(line);
+    fclose(f);
+    return mount;
+}
+
+/* Return the shell's cgroup v2 path relative to the mount, or NULL */
+static char *
+find_own_cgroup(void)
+{
+    FILE *f = fopen("/proc/self/cgroup", "r");
+    if (f == NULL)
+        return NULL;
+
+    char *line = NULL, *path = NULL;
+    size_t size = 0;
+    while (path == NULL && getline(&line, &size, f) != -1) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            path = strdup(line + 3);
+        }
+    }
+    free(line);
+    fclose(f);
+    return path;
+}
+
+/* Write value to file name in directory dirfd */
+static int
+write_file(int dirfd, const char *name, const char *value)
+{
+    int fd = openat(dirfd, name, O_WRONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+    ssize_t len = strlen(value);
+    ssize_t n = write(fd, value, len);
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return n == len ? 0 : -1;
+}
+
+/* Move the shell into the cgroup at path */
+static int
+move_self(const char *path)
+{
+    int fd = open(path, O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+    int rc = write_file(fd, "cgroup.procs", "0");
+    close(fd);
+    return rc;
+}
+
+/* Try again to remove job cgroups that were busy */
+static void
+remove_stale_cgroups(void)
+{
+    for (int i = 0; i < num_stale_paths; ) {
+        if (rmdir(stale_paths[i]) == 0 || errno == ENOENT) {
+            free(stale_paths[i]);
+            stale_paths[i] = stale_paths[--num_stale_paths];
+        } else {
+            i++;
+        }
+    }
+}
+
+static void
+cgroup_cleanup(void)
+{
+    remove_stale_cgroups();
+    if (move_self(orig_path) == 0)
+        unlinkat(base_fd, "shell", AT_REMOVEDIR);
+    rmdir(base_path);
+}
+
+/* Remove the trees of shells that died without cleaning up.  A live
+ * shell holds a lock on its tree, which identifies it even if its pid
+ * is not visible here (another pid namespace).  Trees that still
+ * contain processes are left alone. */
+static void
+remove_dead_shell_cgroups(void)
+{
+    DIR *dir = opendir(orig_path);
+    if (dir == NULL)
+        return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        int pid;
+        if (sscanf(entry->d_name, "cush.%d", &pid) != 1)
+            continue;
+        int fd = openat(dirfd(dir), entry->d_name, O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            continue;
+        DIR *shell_dir = NULL;
+        if (flock(fd, LOCK_EX | LOCK_NB) == -1 || (shell_dir = fdopendir(fd)) == NULL) {
+            close(fd);
+            continue;
+        }
+        struct dirent *child;
+        while ((child = readdir(shell_dir)) != NULL)
+            if (child->d_type == DT_DIR && child->d_name[0] != '.')
+                unlinkat(fd, child->d_name, AT_REMOVEDIR);
+        unlinkat(dirfd(dir), entry->d_name, AT_REMOVEDIR);
+        closedir(shell_dir);
+    }
+    closedir(dir);
+}
+
+/* Create the shell's tree, cush.<pid>, and lock it.  A shell in
+ * another pid namespace may use the same name; then cush.<pid>.<n>
+ * is tried.  Returns the tree's directory fd, or -1. */
+static int
+create_base(void)
+{
+    for (int n = 0; n < 100; n++) {
+        free(base_path);
+        if ((n == 0 ? asprintf(&base_path, "%s/cush.%d", orig_path, getpid())
+                    : asprintf(&base_path, "%s/cush.%d.%d", orig_path, getpid(), n)) == -1)
+            utils_fatal_error("asprintf failed: ");
+        if (mkdir(base_path, 0755) == -1 && errno != EEXIST)
+            return -1;
+        int fd = open(base_path, O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            continue;
+        /* Another shell's cleanup may have removed the directory
+         * before it was locked */
+        struct stat locked, current;
+        if (flock(fd, LOCK_EX | LOCK_NB) == 0 && fstat(fd, &locked) == 0
+                && stat(base_path, &current) == 0 && locked.st_ino == current.st_ino)
+            return fd;
+        close(fd);
+    }
+    errno = EEXIST;
+    return -1;
+}
+
+bool
+cgroup_init(void)
+{
+    char *mount = find_cgroup2_mount();
+    char *own = find_own_cgroup();
+    if (mount == NULL || own == NULL) {
+        fprintf(stderr, "cgroup v2 is not available\n");
+        free(mount);
+        free(own);
+        return false;
+    }
+    if (asprintf(&orig_path, "%s%s", mount, strcmp(own, "/") == 0 ? "" : own) == -1)
+        utils_fatal_error("asprintf failed: ");
+    free(mount);
+    free(own);
+    remove_dead_shell_cgroups();
+
+    if ((base_fd = create_base()) == -1) {
+        utils_error("cannot create %s: ", base_path);
+        return false;
+    }
+    if ((mkdirat(base_fd, "shell", 0755) == -1 && errno != EEXIST)
+            || write_file(base_fd, "shell/cgroup.procs", "0") == -1) {
+        utils_error("cannot move the shell into %s/shell: ", base_path);
+        unlinkat(base_fd, "shell", AT_REMOVEDIR);
+        rmdir(base_path);
+        close(base_fd);
+        return false;
+    }
+    atexit(cgroup_cleanup);
+
+    /* Controllers that the parent does not delegate are simply not
+     * available; the corresponding limits then fail to apply. */
+    write_file(base_fd, "cgroup.subtree_control", "+memory");
+    write_file(base_fd, "cgroup.subtree_control", "+cpu");
+    return true;
+}
+
+int
+cgroup_create(void)
+{
+    char name[32];
+    snprintf(name, sizeof name, "job.%u", next_job_cgroup++);
+    if (mkdirat(base_fd, name, 0755) == -1)
+        return -1;
+    int fd = openat(base_fd, name, O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        unlinkat(base_fd, name, AT_REMOVEDIR);
+    return fd;
+}
+
+void
+cgroup_destroy(int cgfd)
+{
+    char link[64], path[PATH_MAX];
+    snprintf(link, sizeof link, "/proc/self/fd/%d", cgfd);
+    ssize_t len = readlink(link, path, sizeof path - 1);
+    close(cgfd);
+    if (len == -1)
+        return;
+    path[len] = '\0';
+
+    remove_stale_cgroups();
+    if (rmdir(path) == -1 && errno == EBUSY) {
+        stale_paths = realloc(stale_paths, (num_stale_paths + 1) * sizeof *stale_paths);
+        if (stale_paths == NULL)
+            utils_fatal_error("realloc failed: ");
+        stale_paths[num_stale_paths++] = strdup(path);
+    }
+}
+
+int
+cgroup_write(int cgfd, const char *name, const char *value)
+{
+    return write_file(cgfd, name, value);
+}
+
+int
+cgroup_kill(int cgfd)
+{
+    return write_file(cgfd, "cgroup.kill", "1");
+}
+
+void
+cgroup_print_stats(FILE *out, int cgfd)
+{
+    char line[128];
+    long long usage = 0, user = 0, system = 0, peak = -1;
+
+    int fd = openat(cgfd, "cpu.stat", O_RDONLY | O_CLOEXEC);
+    FILE *f = fd == -1 ? NULL : fdopen(fd, "r");
+    if (f != NULL) {
+        while (fgets(line, sizeof line, f) != NULL) {
+            sscanf(line, "usage_usec %lld", &usage);
+            sscanf(line, "user_usec %lld", &user);
+            sscanf(line, "system_usec %lld", &system);
+        }
+        fclose(f);
+    }
+
+    fd = openat(cgfd, "memory.peak", O_RDONLY | O_CLOEXEC);
+    f = fd == -1 ? NULL : fdopen(fd, "r");
+    if (f != NULL) {
+        if (fscanf(f, "%lld", &peak) != 1)
+            peak = -1;
+        fclose(f);
+    }
+
+    fprintf(out, "cgroup cpu %lld.%03llds (user %lld.%03llds sys %lld.%03llds)",
+            usage / 1000000, usage / 1000 % 1000,
+            user / 1000000, user / 1000 % 1000,
+            system / 1000000, system / 1000 % 1000);
+    if (peak >= 0)
+        fprintf(out, " memory.peak %lld KiB", peak / 1024);
+    else
+        fprintf(out, " memory.peak -");
+}
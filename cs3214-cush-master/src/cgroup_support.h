@@ -0,0 +1,48 @@
+#ifndef __CGROUP_SUPPORT_H
+#define __CGROUP_SUPPORT_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * Per-job cgroup v2 support.
+ *
+ * cgroup_init() sets up a tree below the shell's own cgroup:
+ *
+ *   <shell's cgroup>/cush.<pid>/          controllers enabled for children
+ *   <shell's cgroup>/cush.<pid>/shell/    the shell itself
+ *   <shell's cgroup>/cush.<pid>/job.<n>/  one per job
+ *
+ * The shell moves into a leaf of its own because cgroups that
+ * distribute resources to children may not contain processes.
+ * It holds a flock() on cush.<pid> while it runs, so that other shells
+ * remove only trees whose shell is gone.  A shell in another pid
+ * namespace may have the same pid; the tree is then cush.<pid>.<n>.
+ * Job cgroups are referred to by open directory fds, which can be
+ * passed to posix_spawnattr_setcgroup_np().
+ */
+
+/* Set up the cgroup tree.  Returns false, with a message on stderr,
+ * if cgroup v2 is not available or not writable.  The tree is removed
+ * when the shell exits. */
+bool cgroup_init(void);
+
+/* Create a cgroup for a new job and return its directory fd, or -1 */
+int cgroup_create(void);
+
+/* Remove a job's cgroup and close cgfd.  Removal is retried later
+ * if processes are still leaving it. */
+void cgroup_destroy(int cgfd);
+
+/* Write value to the control file name of a cgroup, return 0 or -1 */
+int cgroup_write(int cgfd, const char *name, const char *value);
+
+/* Kill all processes in a cgroup, including descendants that left
+ * the job's process group; return 0 or -1 */
+int cgroup_kill(int cgfd);
+
+/* Print cpu.stat usage and memory.peak of a cgroup as a single line
+ * (without newline) */
+void cgroup_print_stats(FILE *out, int cgfd);
+
+#endif /* __CGROUP_SUPPORT_H */
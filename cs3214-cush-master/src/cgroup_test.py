@@ -0,0 +1,77 @@
+#!/usr/bin/python
+#
+# Tests per-job cgroups (cush -c): jobs are placed in their own
+# cgroup, jobs -l reports its statistics, and kill tears down
+# processes that left the job's process group.
+#
+import atexit, proc_check, tempfile, time
+from testutils import *
+
+console = setup_tests([" -c"])
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+def cgroup_of(pid):
+    with open("/proc/" + str(pid) + "/cgroup") as f:
+        for line in f:
+            if line.startswith("0::"):
+                return line[3:].strip()
+    return ""
+
+def is_alive(pid):
+    try:
+        with open("/proc/" + pid + "/stat") as f:
+            return f.read().rsplit(")", 1)[1].split()[0] != "Z"
+    except (IOError, IndexError):
+        return False
+
+def cgroup_mount():
+    with open("/proc/self/mountinfo") as f:
+        for line in f:
+            if " - cgroup2 " in line:
+                return line.split()[4]
+    return ""
+
+shell_cgroup = cgroup_of(console.pid)
+if not shell_cgroup.endswith("/shell"):
+    # cgroup v2 is not available or not writable here
+    sendline("exit")
+    test_success("(skipped: no cgroup v2)")
+
+# the job's process is in the job's cgroup
+sendline("sleep 30 &")
+(jobid, pid) = parse_bg_status()
+expect_prompt("Shell did not print expected prompt (2)")
+job_cgroup = cgroup_of(pid)
+assert job_cgroup.startswith(shell_cgroup[:-len("shell")] + "job."), 'job is not in its own cgroup'
+
+sendline("jobs -l")
+expect_regex(r"cgroup cpu (\d+\.\d+)s")
+expect_prompt("Shell did not print expected prompt (3)")
+
+# a process that moved to its own session is killed along with the job
+script = tempfile.NamedTemporaryFile(mode="w", suffix=".sh", delete=False)
+script.write("setsid sleep 31 &\nsleep 31\n")
+script.close()
+atexit.register(os.unlink, script.name)
+sendline("sh " + script.name + " &")
+(jobid2, pid2) = parse_bg_status()
+expect_prompt("Shell did not print expected prompt (4)")
+time.sleep(0.5)
+procs = cgroup_mount() + cgroup_of(pid2) + "/cgroup.procs"
+with open(procs) as f:
+    escaped = [p for p in f.read().split() if os.getpgid(int(p)) != int(pid2)]
+assert len(escaped) == 1, 'setsid sleep did not leave the process group'
+run_builtin('kill', jobid2)
+expect_prompt("Shell did not print expected prompt (5)")
+time.sleep(0.5)
+assert not is_alive(escaped[0]), 'process outside the process group was not killed'
+
+run_builtin('kill', jobid)
+expect_prompt("Shell did not print expected prompt (6)")
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
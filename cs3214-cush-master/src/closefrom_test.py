@@ -0,0 +1,31 @@
+#!/usr/bin/python
+#
+# Tests that every stage of a pipeline starts with only fds 0-2
+# open, and that pipelines end as soon as their last stage exits:
+# `yes` in a 20-stage pipeline must not keep running after `head`
+# exited.
+#
+import atexit, proc_check, time
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# ls's own directory fd is the only one besides 0-2
+for cmd in ["ls /proc/self/fd | cat", "true | ls /proc/self/fd | cat"]:
+    sendline(cmd)
+    expect_exact("0\r\n1\r\n2\r\n3\r\n", "stage started with extra fds: " + cmd)
+    expect_prompt()
+
+start = time.time()
+sendline("yes | " + "cat | " * 18 + "head -n 1")
+expect_exact("y\r\n", "head did not print a line")
+expect_prompt("pipeline did not terminate")
+assert time.time() - start < 1, 'pipeline took too long to terminate'
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,59 @@
+/*
+ * Single-producer, single-consumer ring of child status changes.
+ *
+ * head and tail count pushes and pops modulo 2^32; their difference
+ * is the number of filled slots.  Each side only writes its own
+ * index, and the release/acquire pairs order the slot contents
+ * before the index update that publishes (or frees) the slot.
+ */
+#include <string.h>
+
+#include "completion_ring.h"
+
+#define SLOT(ring, n) (&(ring)->slots[(n) & (COMPLETION_RING_SIZE - 1)])
+
+void
+completion_ring_init(struct completion_ring *ring)
+{
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+}
+
+bool
+completion_ring_full(struct completion_ring *ring)
+{
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    return head - tail == COMPLETION_RING_SIZE;
+}
+
+bool
+completion_ring_push(struct completion_ring *ring, pid_t pid, int status,
+                     const struct rusage *ru)
+{
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail == COMPLETION_RING_SIZE)
+        return false;
+
+    struct child_completion *slot = SLOT(ring, head);
+    slot->pid = pid;
+    slot->status = status;
+    slot->has_usage = ru != NULL;
+    if (ru != NULL)
+        memcpy(&slot->usage, ru, sizeof *ru);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+int
+completion_ring_drain(struct completion_ring *ring, struct child_completion *out, int max)
+{
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    int n = 0;
+    for (; n < max && tail != head; n++, tail++)
+        out[n] = *SLOT(ring, tail);
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    return n;
+}
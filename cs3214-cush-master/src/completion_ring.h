@@ -0,0 +1,51 @@
+#ifndef __COMPLETION_RING_H
+#define __COMPLETION_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+/*
+ * A fixed-size, lock-free ring of child status changes passed from
+ * the code that reaps children (the producer) to the code that
+ * updates jobs (the consumer).
+ *
+ * There must be at most one producer and one consumer.  Pushing
+ * never allocates, locks or calls into stdio, so it may be done
+ * from a signal handler that interrupts the consumer.  A producer
+ * must not drain the ring itself when it is full; it should leave
+ * the status change where it came from (e.g. the child unreaped)
+ * until the consumer made room.
+ */
+#define COMPLETION_RING_SIZE 256     /* must be a power of 2 */
+
+struct child_completion {
+    pid_t pid;
+    int status;              /* as reported by waitpid() */
+    bool has_usage;          /* usage is valid (the process was reaped) */
+    struct rusage usage;
+};
+
+struct completion_ring {
+    atomic_uint head;        /* next slot to fill; advanced by the producer */
+    atomic_uint tail;        /* next slot to drain; advanced by the consumer */
+    struct child_completion slots[COMPLETION_RING_SIZE];
+};
+
+/* Initialize an empty ring */
+void completion_ring_init(struct completion_ring *ring);
+
+/* Return true if the ring has no free slot.  Async-signal-safe. */
+bool completion_ring_full(struct completion_ring *ring);
+
+/* Append a status change; ru may be NULL.  Returns false, without
+ * adding it, if the ring is full.  Async-signal-safe. */
+bool completion_ring_push(struct completion_ring *ring, pid_t pid, int status,
+                          const struct rusage *ru);
+
+/* Move up to max of the oldest entries into out and return how many
+ * were moved. */
+int completion_ring_drain(struct completion_ring *ring, struct child_completion *out, int max);
+
+#endif /* __COMPLETION_RING_H */
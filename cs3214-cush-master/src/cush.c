@@ -15,8 +15,18 @@
 #include <string.h>
 #include <termios.h>
 #include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/ioprio.h>
+#include <sched.h>
 #include <assert.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
 #include <readline/history.h>
 /* Since the handed out code contains a number of unused functions. */
 #pragma GCC diagnostic ignored "-Wunused-function"
@@ -24,16 +34,34 @@
 #include "signal_support.h"
 #include "shell-ast.h"
 #include "utils.h"
+#include "pid_table.h"
+#include "jid_bitmap.h"
+#include "rusage_support.h"
+#include "cgroup_support.h"
+#include "timer_heap.h"
+#include "completion_ring.h"
+#include "job_export.h"
+#include "path_cache.h"
+#include "env_table.h"
+#include "spawn_helper.h"
 #include "spawn.h"
-#define MAXJOBS (1<<16)
-#define PIPE_READ (0)
-#define PIPE_WRITE (1)
-static void handle_child_status(pid_t pid, int status);
+#define MAXJOBS JID_BITMAP_SIZE
+static void handle_child_status(pid_t pid, int status, const struct rusage *ru);
+static void dispatch_batch_jobs(void);
+static void complete_pending_spawns(int max);
+static void collect_spawn_replies(void);
+static struct job *get_spawned_job(int jid);
 static void
 usage(char *progname)
 {
-    printf("Usage: %s -h\n"
-        " -h            print this help\n", progname);  
+    printf("Usage: %s [-h] [-p] [-r] [-c] [-e] [-t] [-s]\n"
+        " -h            print this help\n"
+        " -p            track children through pidfds\n"
+        " -r            report resource usage when a job completes\n"
+        " -c            run each job in its own cgroup\n"
+        " -e            export the job table to /dev/shm/cush.<pid>\n"
+        " -t            spawn the commands of long pipelines in parallel\n"
+        " -s            spawn commands from a helper process\n", progname);
     exit(EXIT_SUCCESS);
 }
 /* Build a prompt */
@@ -48,6 +76,32 @@ enum job_status {
     STOPPED,      /* job is stopped via SIGSTOP */
     NEEDSTERMINAL,/* job is stopped because it was a background job and requires exclusive terminal access */
     FINISHED,         /* job is finished running */
+    QUEUED,       /* job was submitted with batch and waits for a free slot */
+};
+enum job_timeout {
+    NO_TIMEOUT,
+    TIMEOUT_PENDING,  /* job has a deadline that has not passed yet */
+    TIMED_OUT,        /* job was sent its timeout signal */
+    TIMEOUT_KILLED,   /* job was killed after the grace period */
+};
+/* How a job's processes are scheduled, as set with the run builtin */
+struct job_sched {
+    short flags;             /* POSIX_SPAWN_SETAFFINITY, _SETNICE, _SETSCHEDULER, _SETIOPRIO */
+    cpu_set_t cpus;
+    int nice;
+    int policy;
+    int ioprio;
+};
+/* Resource limits for spawned processes, as set with the ulimit builtin */
+struct job_rlimits {
+    unsigned int mask;       /* 1 << resource for each limit that is set */
+    struct rlimit limits[RLIM_NLIMITS];
+};
+/* The output of a builtin that is a command of a pipeline, kept until
+ * the command after it is spawned to read it */
+struct builtin_output {
+    int fd;                  /* memfd holding the output, or -1 */
+    char path[32];           /* What the next command opens, or "" if not a builtin */
 };
 struct job {
     struct list_elem elem;   /* Link element for jobs list. */
@@ -56,15 +110,115 @@ struct job {
     enum job_status status;  /* Job status. */
     int num_processes_alive; /* The number of processes that we know to be alive */
     struct termios saved_tty_state; /* The state of the terminal when this job was stopped after having been in foreground */
-    pid_t *pids;             /* Add additional fields here if needed. */
+    pid_t *pids;             /* Processes spawned for this job, one slot per command in the pipeline */
+    int *pidfds;             /* pidfds for pids, -1 once reaped (only with -p) */
+    int num_pids;            /* Number of entries used in pids */
+    struct rusage usage;     /* Accumulated usage of the processes reaped so far */
+    int exit_status;         /* Exit status of the last command, 128+signal if it was killed or stopped */
+    bool waited_for;         /* The wait builtin is blocked on this job */
+    bool holds_batch_slot;   /* A batch job whose processes count against batch_limit */
+    bool spawn_pending;      /* Sent to the spawn helper, whose reply is not collected yet */
+    struct list_elem queue_elem; /* Link element for batch_queue while QUEUED,
+                                    and for pending_spawns until it is spawned */
+    struct list_elem finished_elem; /* Link element for finished_jobs while FINISHED */
+    int cgroup_fd;           /* The job's cgroup directory (only with -c), or -1 */
+    enum job_timeout timeout;
+    struct timer_heap_elem deadline; /* When the next timeout action is due */
+    int timeout_signal;      /* Signal sent when the deadline passes */
+    long long timeout_grace; /* ms after which SIGKILL follows */
+    long long start_time;    /* When the job was spawned, in ms since the Epoch */
+    struct job_sched *sched; /* Scheduling set by run, or NULL */
+    struct job_rlimits *rlimits; /* Limits set by ulimit ... -- cmd, or NULL */
+    struct builtin_output *builtin_outputs; /* One per command until the job is
+                                               spawned, if it has builtins; or NULL */
 };
+static void export_job(struct job *job);
+static void run_pipeline_builtins(struct job *job);
 /* Utility functions for job list management.
- * We use 2 data structures:
+ * We use 4 data structures:
  * (a) an array jid2job to quickly find a job based on its id
- * (b) a linked list to support iteration
+ * (b) a bitmap of jids in use to allocate the lowest free jid and
+ *     to iterate over live jobs in jid order
+ * (c) a hash table pid2job to quickly find the job a child belongs to
+ * (d) a linked list to support iteration
  */
 static struct list job_list;
+/* Jobs that are FINISHED and can be deleted */
+static struct list finished_jobs;
+/* Exit statuses of deleted finished jobs by jid, or -1, so the wait
+ * builtin can still report them.  An entry is kept until wait reads
+ * it or its jid is reused; the table grows with the highest jid. */
+static int *deleted_statuses;
+static int deleted_statuses_size;
 static struct job *jid2job[MAXJOBS];
+static struct jid_bitmap jids_in_use;
+static struct pid_table pid2job;
+
+/* The child event set: an epoll set holding a signalfd for SIGCHLD,
+ * with -p a pidfd for every child (SIGCHLD then only serves to report
+ * stops), and with -s the spawn helper's socket.  Both foreground
+ * waits and background notifications are served from it.  It also
+ * holds a signalfd for SIGINT, which is blocked only while the wait
+ * builtin runs. */
+static bool use_pidfds;
+static int child_events_fd = -1;
+static int sigchld_fd = -1;
+static int sigint_fd = -1;
+#define SIGCHLD_EVENT 0      /* epoll data for sigchld_fd; pidfds use their pid */
+#define SPAWN_HELPER_EVENT UINT64_MAX   /* epoll data for the spawn helper's socket */
+#define SIGINT_EVENT (UINT64_MAX - 1)   /* epoll data for sigint_fd */
+/* Set when the user typed Ctrl-C while the wait builtin was blocked */
+static bool wait_interrupted;
+/* pid -> pidfd for processes whose job was deleted before they were reaped */
+static struct pid_table orphan_pidfds;
+/* Set by -r: print a job's resource usage when it completes */
+static bool report_usage;
+/* Exit status of the last foreground job or wait builtin, or the one
+ * given to exit, which is the shell's exit status */
+static int last_status;
+/* Set when the user typed EOF or exit; the main loop then returns
+ * last_status */
+static bool shell_exiting;
+/* Jobs the wait builtin is still blocked on, and the first of them
+ * to finish; both are maintained by handle_child_status() so waiting
+ * costs O(1) per event regardless of the number of jobs. */
+static int num_waited_for;
+static struct job *first_waited_done;
+/* Jobs submitted with batch wait in batch_queue, in submission order,
+ * and are started as long as fewer than batch_limit of them run. */
+static struct list batch_queue;
+static int batch_limit;
+static int num_batch_running;
+/* Set by -c if cgroup v2 could be set up */
+static bool use_cgroups;
+/* Set by -e if the job table could be exported */
+static bool export_jobs;
+/* Set by -t: threads that spawn the stages of pipelines with at least
+ * PARALLEL_SPAWN_MIN_STAGES commands concurrently.  Each spawn suspends
+ * only its own thread until the child execs, so even one CPU gets two. */
+static int spawn_workers = 1;
+#define PARALLEL_SPAWN_MIN_STAGES 4
+/* Limits set by ulimit.  They are applied to the processes the shell
+ * spawns, at spawn time, and not to the shell itself. */
+static struct job_rlimits shell_rlimits;
+/* The job whose builtins are running, which jobs does not list */
+static struct job *launching_job;
+/* Set by -s if the spawn helper could be started.  Background jobs
+ * sent to it wait in pending_spawns, in submission order, until its
+ * reply is collected.  Replies are collected as they arrive, from the
+ * child event set; only what needs a job's processes waits for them. */
+static bool use_spawn_helper;
+static struct list pending_spawns;
+/* Deadlines of jobs started with timeout.  The earliest one bounds
+ * how long the shell waits for events. */
+static struct timer_heap deadlines;
+
+/* Iterate over live jobs in jid order.  The current job may be deleted
+ * in the loop body. */
+#define for_each_job(job, jid) \
+    for (int jid = jid_bitmap_next(&jids_in_use, 1); \
+         jid != -1 && ((job) = jid2job[jid], true); \
+         jid = jid_bitmap_next(&jids_in_use, jid + 1))
 /* Return job corresponding to jid */
 static struct job *
 get_job_from_jid(int jid)
@@ -73,34 +227,85 @@ get_job_from_jid(int jid)
         return jid2job[jid];
     return NULL;
 }
-static int findEmptyPIDSlot(struct job* theJob) {
-    for (int i = 0; i < MAXJOBS; i++) {
-        if (theJob->pids[i] == 0) {
-            return i;
-        }
+/* Record a process spawned for this job, with the pidfd
+ * spawn returned for it (only with -p) */
+static void
+add_pid_to_job(struct job *job, pid_t pid, int pidfd)
+{
+    if (use_pidfds) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.u64 = pid };
+        if (epoll_ctl(child_events_fd, EPOLL_CTL_ADD, pidfd, &ev) == -1)
+            utils_fatal_error("epoll_ctl failed for pidfd %d: ", pidfd);
+        job->pidfds[job->num_pids] = pidfd;
     }
-    printf("THE INDEX RETURNED IS -1\n");
-    return -1;
+    job->pids[job->num_pids++] = pid;
+    job->num_processes_alive++;
+    export_job(job);
+    pid_table_insert(&pid2job, pid, job);
 }
 /* Add a new job to the job list */
 static struct job*
 add_job(struct ast_pipeline *pipe)
 {
     struct job *job = calloc(1, sizeof *job); // MODIFIED TO USE CALLOC TO PREVENT VALGRIND ERRORS (originally malloc)
+    if (job == NULL)
+        utils_fatal_error("cannot allocate job: ");
     job->pipe = pipe;
     job->num_processes_alive = 0;
-    job->pids = (pid_t*) calloc(MAXJOBS, sizeof(pid_t)); // CALLOC FOR PID ARRAY
+    job->pids = calloc(list_size(&pipe->commands), sizeof(pid_t)); // one slot per command in the pipeline
+    if (job->pids == NULL)
+        utils_fatal_error("cannot allocate job: ");
+    if (use_pidfds && (job->pidfds = calloc(list_size(&pipe->commands), sizeof(int))) == NULL)
+        utils_fatal_error("cannot allocate job: ");
+    job->num_pids = 0;
+    job->cgroup_fd = -1;
+    timer_heap_elem_init(&job->deadline);
+    if (use_cgroups && (job->cgroup_fd = cgroup_create()) == -1)
+        utils_error("cannot create a cgroup for the job: ");
     list_push_back(&job_list, &job->elem);
-    for (int i = 1; i < MAXJOBS; i++) {
-        if (jid2job[i] == NULL) {
-            jid2job[i] = job;
-            job->jid = i;
-            return job;
-        }
+    int jid = jid_bitmap_alloc(&jids_in_use);
+    if (jid == -1) {
+        fprintf(stderr, "Maximum number of jobs exceeded\n");
+        abort();
+    }
+    jid2job[jid] = job;
+    job->jid = jid;
+    if (jid < deleted_statuses_size)
+        deleted_statuses[jid] = -1;
+    export_job(job);
+    return job;
+}
+/* Close the files holding the output of a job's builtins, which its
+ * other commands have opened once they are spawned */
+static void
+release_builtin_outputs(struct job *job)
+{
+    if (job->builtin_outputs == NULL)
+        return;
+    for (int i = 0; i < list_size(&job->pipe->commands); i++)
+        if (job->builtin_outputs[i].fd != -1)
+            close(job->builtin_outputs[i].fd);
+    free(job->builtin_outputs);
+    job->builtin_outputs = NULL;
+}
+/* Give up the batch slot a job holds, if any */
+static void
+release_batch_slot(struct job *job)
+{
+    if (job->holds_batch_slot) {
+        job->holds_batch_slot = false;
+        num_batch_running--;
+    }
+}
+/* Mark a job as finished, to be deleted by removeFinishedJobs() */
+static void
+mark_finished(struct job *job)
+{
+    if (job->status != FINISHED) {
+        job->status = FINISHED;
+        list_push_back(&finished_jobs, &job->finished_elem);
+        export_job(job);
     }
-    fprintf(stderr, "Maximum number of jobs exceeded\n");
-    abort();
-    return NULL;
 }
 /* Delete a job.
  * This should be called only when all processes that were forked for this job are known to have terminated.
@@ -110,10 +315,34 @@ delete_job(struct job *job)
 {
     int jid = job->jid;
     assert(jid != -1);
+    /* Drop index entries for processes that were never reaped */
+    for (int i = 0; i < job->num_pids; i++) {
+        if (pid_table_lookup(&pid2job, job->pids[i]) == job)
+            pid_table_remove(&pid2job, job->pids[i]);
+        /* Keep watching processes that were not reaped yet so they
+         * do not linger as zombies */
+        if (use_pidfds && job->pidfds[i] != -1)
+            pid_table_insert(&orphan_pidfds, job->pids[i], (void *) (intptr_t) job->pidfds[i]);
+    }
+    if (job->status == QUEUED)
+        list_remove(&job->queue_elem);
+    if (job->status == FINISHED)
+        list_remove(&job->finished_elem);
+    release_batch_slot(job);
+    if (export_jobs)
+        job_export_remove(jid);
     jid2job[jid]->jid = -1;
     jid2job[jid] = NULL;
+    jid_bitmap_clear(&jids_in_use, jid);
+    if (job->cgroup_fd != -1)
+        cgroup_destroy(job->cgroup_fd);
+    timer_heap_remove(&deadlines, &job->deadline);
     ast_pipeline_free(job->pipe);
     free(job->pids);
+    free(job->pidfds);
+    free(job->sched);
+    free(job->rlimits);
+    release_builtin_outputs(job);
     free(job);
 }
 static const char *
@@ -130,6 +359,8 @@ get_status(enum job_status status)
         return "Stopped (tty)";
     case FINISHED:
         return "Done";
+    case QUEUED:
+        return "Queued";
     default:
         return "Unknown";
     }
@@ -149,38 +380,320 @@ print_cmdline(struct ast_pipeline *pipeline)
             printf(" %s", *p++);
     }
 }
+/* Write the command line that belongs to one job into buf,
+ * truncating it to size. */
+static void
+format_cmdline(struct ast_pipeline *pipeline, char *buf, size_t size)
+{
+    size_t len = 0;
+    buf[0] = '\0';
+    struct list_elem *e = list_begin(&pipeline->commands);
+    for (; e != list_end(&pipeline->commands); e = list_next(e)) {
+        struct ast_command *cmd = list_entry(e, struct ast_command, elem);
+        for (char **p = cmd->argv; *p != NULL && len < size; p++)
+            len += snprintf(buf + len, size - len, "%s%s",
+                            len == 0 ? "" : p == cmd->argv ? " | " : " ", *p);
+    }
+}
+/* True while readline shows the prompt and a partially typed line */
+static bool prompt_visible;
+/* True if async output has erased the prompt, which must be redrawn */
+static bool prompt_erased;
+/* Call before printing while the user may be typing a command line,
+ * e.g. when reporting a background job.  Erases the prompt and input
+ * so the output does not mix with them; the main loop redraws them. */
+static void
+begin_async_output(void)
+{
+    if (prompt_visible && !prompt_erased) {
+        rl_clear_visible_line();
+        prompt_erased = true;
+    }
+}
+/* Return the status of a job to show to the user */
+static const char *
+get_job_status(struct job *job)
+{
+    if (job->status != FINISHED && job->timeout == TIMED_OUT)
+        return "Timed out";
+    if (job->status != FINISHED && job->timeout == TIMEOUT_KILLED)
+        return "Timed out, killed";
+    return get_status(job->status);
+}
+/* Mirror a job into the exported job table (only with -e).  Called
+ * wherever a job's status or processes change. */
+static void
+export_job(struct job *job)
+{
+    if (!export_jobs)
+        return;
+    struct job_export_entry entry = {
+        .jid = job->jid,
+        .pgid = job->num_pids > 0 ? job->pids[0] : 0,
+        .num_pids = job->num_pids,
+        .start_time = job->num_pids > 0 ? job->start_time : 0,
+    };
+    for (int i = 0; i < job->num_pids && i < JOB_EXPORT_MAX_PIDS; i++)
+        entry.pids[i] = job->pids[i];
+    snprintf(entry.status, sizeof entry.status, "%s", get_job_status(job));
+    format_cmdline(job->pipe, entry.cmdline, sizeof entry.cmdline);
+    job_export_publish(&entry);
+}
 /* Print a job */
 static void
 print_job(struct job *job)
 {
-    printf("[%d]\t%s\t\t", job->jid, get_status(job->status));
+    begin_async_output();
+    printf("[%d]\t%s\t\t", job->jid, get_job_status(job));
     print_cmdline(job->pipe);
     printf(")\n");
 }
+/* Print a job's resource usage, including the usage so far of
+ * processes that are still running. */
+static void
+print_job_usage(struct job *job)
+{
+    struct rusage usage = job->usage;
+    for (int i = 0; i < job->num_pids; i++)
+        if (pid_table_lookup(&pid2job, job->pids[i]) == job)
+            rusage_add_live(&usage, job->pids[i]);
+
+    begin_async_output();
+    printf("\t");
+    rusage_print(stdout, &usage);
+    printf("\n");
+}
 /*
- * Suggested SIGCHLD handler.
+ * Reaping children and updating jobs are decoupled: the reap_*
+ * functions only collect status changes into the completions ring,
+ * and drain_completions() applies them to jobs in batches.  The
+ * producer side does no allocation or output, and never drains the
+ * ring: when it is full, it leaves the remaining children unreaped
+ * and returns false, and its caller reaps again once
+ * drain_completions() has made room.
+ */
+static struct completion_ring completions;
+/* Apply the status changes collected so far to their jobs */
+static void
+drain_completions(void)
+{
+    struct child_completion batch[32];
+    int n;
+    while ((n = completion_ring_drain(&completions, batch, sizeof batch / sizeof batch[0])) > 0)
+        for (int i = 0; i < n; i++) {
+            // A child may exit before the spawn helper's reply that
+            // names it is collected.  The processes of deleted jobs
+            // belong to no job either, and make this wait for all
+            // replies, which rarely takes long.
+            while (pid_table_lookup(&pid2job, batch[i].pid) == NULL && !list_empty(&pending_spawns))
+                complete_pending_spawns(1);
+            handle_child_status(batch[i].pid, batch[i].status,
+                                batch[i].has_usage ? &batch[i].usage : NULL);
+        }
+}
+/*
+ * SIGCHLD stays blocked for the shell's lifetime.  A signalfd
+ * (sigchld_fd) reports it instead, so child status changes are
+ * processed synchronously wherever the shell waits for events:
+ * in the main loop while reading a command line, and in
+ * wait_for_job().
  *
- * Call waitpid() to learn about any child processes that
- * have exited or changed status (been stopped, needed the
- * terminal, etc.)
- * Just record the information by updating the job list
- * data structures. Since the call may be spurious (e.g.
- * an already pending SIGCHLD is delivered even though
- * a foreground process was already reaped), ignore when
- * waitpid returns -1.
  * Use a loop with WNOHANG since only a single SIGCHLD
- * signal may be delivered for multiple children that have
+ * signal may be pending for multiple children that have
  * exited. All of them need to be reaped.
+ *
+ * Returns false if it stopped because the completions ring is full.
  */
-static void
-sigchld_handler(int sig, siginfo_t *info, void *_ctxt)
+static bool
+reap_children(void)
 {
     pid_t child;
     int status;
-    assert(sig == SIGCHLD);
-    while ((child = waitpid(-1, &status, WUNTRACED|WNOHANG)) > 0) {
-        handle_child_status(child, status);
+    struct rusage ru;
+    while (!completion_ring_full(&completions)) {
+        if ((child = wait4(-1, &status, WUNTRACED|WNOHANG, &ru)) <= 0)
+            return true;
+        completion_ring_push(&completions, child, status, WIFSTOPPED(status) ? NULL : &ru);
+    }
+    return false;
+}
+/* Translate the siginfo filled in by waitid() into a waitpid() status */
+static int
+siginfo_to_status(siginfo_t *info)
+{
+    switch (info->si_code) {
+    case CLD_EXITED:
+        return W_EXITCODE(info->si_status, 0);
+    case CLD_KILLED:
+        return W_EXITCODE(0, info->si_status);
+    case CLD_DUMPED:
+        return W_EXITCODE(0, info->si_status) | WCOREFLAG;
+    case CLD_CONTINUED:
+        return 0xffff;
+    default:    /* CLD_STOPPED, CLD_TRAPPED */
+        return W_STOPCODE(info->si_status);
+    }
+}
+/* Report children that stopped.  Exits are reported through their
+ * pidfds only, so this never reaps a process.  Returns false if it
+ * stopped because the completions ring is full. */
+static bool
+reap_stopped_children(void)
+{
+    while (!completion_ring_full(&completions)) {
+        siginfo_t info = { .si_pid = 0 };
+        if (waitid(P_ALL, 0, &info, WSTOPPED|WNOHANG) == -1 || info.si_pid == 0)
+            return true;
+        completion_ring_push(&completions, info.si_pid, siginfo_to_status(&info), NULL);
+    }
+    return false;
+}
+/* Reap the process behind a readable pidfd.  If the completions ring
+ * is full, the pidfd stays readable and is reported again. */
+static void
+reap_pidfd(pid_t pid)
+{
+    struct job *job = pid_table_lookup(&pid2job, pid);
+    if (job == NULL) {
+        int pidfd = (intptr_t) pid_table_remove(&orphan_pidfds, pid);
+        if (pidfd > 0) {
+            waitid(P_PIDFD, pidfd, &(siginfo_t) { .si_pid = 0 }, WEXITED|WNOHANG);
+            close(pidfd);
+        }
+        return;
     }
+
+    for (int i = 0; i < job->num_pids && !completion_ring_full(&completions); i++) {
+        if (job->pids[i] != pid || job->pidfds[i] == -1)
+            continue;
+
+        /* glibc's waitid() does not expose the rusage argument of
+         * the system call */
+        siginfo_t info = { .si_pid = 0 };
+        struct rusage ru;
+        if (syscall(SYS_waitid, P_PIDFD, job->pidfds[i], &info, WEXITED|WNOHANG, &ru) == -1
+            || info.si_pid == 0)
+            return;
+        close(job->pidfds[i]);
+        job->pidfds[i] = -1;
+        completion_ring_push(&completions, pid, siginfo_to_status(&info), &ru);
+        return;
+    }
+}
+/* Current time in ms, for job deadlines */
+static long long
+now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+/* Return the ms until the next job deadline, or -1 if there is none */
+static int
+next_timeout(void)
+{
+    struct timer_heap_elem *next = timer_heap_min(&deadlines);
+    if (next == NULL)
+        return -1;
+    long long ms = next->expiry - now_ms();
+    return ms < 0 ? 0 : ms > INT_MAX ? INT_MAX : ms;
+}
+/* Signal jobs whose deadline has passed: first with their timeout
+ * signal, then, after the grace period, with SIGKILL. */
+static void
+expire_timeouts(void)
+{
+    long long now = now_ms();
+    struct timer_heap_elem *next;
+    while ((next = timer_heap_min(&deadlines)) != NULL && next->expiry <= now) {
+        struct job *job = timer_heap_entry(next, struct job, deadline);
+        if (job->spawn_pending) {   // the job may be gone once it has its processes
+            get_spawned_job(job->jid);
+            continue;
+        }
+        timer_heap_remove(&deadlines, next);
+        if (job->timeout == TIMEOUT_PENDING) {
+            killpg(job->pids[0], job->timeout_signal);
+            if (job->status == STOPPED) // let it see the signal
+                killpg(job->pids[0], SIGCONT);
+            job->timeout = TIMED_OUT;
+            timer_heap_add(&deadlines, &job->deadline, now + job->timeout_grace);
+        } else {
+            if (job->cgroup_fd == -1 || cgroup_kill(job->cgroup_fd) == -1)
+                killpg(job->pids[0], SIGKILL);
+            job->timeout = TIMEOUT_KILLED;
+        }
+        export_job(job);
+        print_job(job);
+    }
+}
+/* Wait up to timeout ms (-1: indefinitely) for events in the child
+ * event set and handle them.  The wait ends early at the next job
+ * deadline. */
+static void
+process_child_events(int timeout)
+{
+    collect_spawn_replies();
+    int deadline = next_timeout();
+    if (deadline != -1 && (timeout == -1 || deadline < timeout))
+        timeout = deadline;
+
+    struct epoll_event events[64];
+    int n = epoll_wait(child_events_fd, events, sizeof events / sizeof events[0], timeout);
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.u64 == SIGCHLD_EVENT) {
+            struct signalfd_siginfo info;
+            while (read(sigchld_fd, &info, sizeof info) == sizeof info)
+                continue;
+            // SIGCHLD is not raised again for children left unreaped
+            while (!(use_pidfds ? reap_stopped_children() : reap_children()))
+                drain_completions();
+        } else if (events[i].data.u64 == SIGINT_EVENT) {
+            struct signalfd_siginfo info;
+            while (read(sigint_fd, &info, sizeof info) == sizeof info)
+                wait_interrupted = true;
+        } else if (events[i].data.u64 == SPAWN_HELPER_EVENT) {
+            collect_spawn_replies();
+            if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                // Jobs are spawned in the shell from now on
+                complete_pending_spawns(-1);
+                epoll_ctl(child_events_fd, EPOLL_CTL_DEL, spawn_helper_fd(), NULL);
+                use_spawn_helper = false;
+            }
+        } else {
+            reap_pidfd(events[i].data.u64);
+        }
+    }
+    drain_completions();
+    expire_timeouts();
+    /* Jobs that completed may have freed batch slots */
+    dispatch_batch_jobs();
+}
+/* Block SIGCHLD and set up the child event set */
+static void
+init_child_events(void)
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    signal_block(SIGCHLD);
+
+    child_events_fd = epoll_create1(EPOLL_CLOEXEC);
+    sigchld_fd = signalfd(-1, &mask, SFD_NONBLOCK|SFD_CLOEXEC);
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigint_fd = signalfd(-1, &mask, SFD_NONBLOCK|SFD_CLOEXEC);
+    if (child_events_fd == -1 || sigchld_fd == -1 || sigint_fd == -1)
+        utils_fatal_error("cannot set up child event set: ");
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = SIGCHLD_EVENT };
+    struct epoll_event sigint_ev = { .events = EPOLLIN, .data.u64 = SIGINT_EVENT };
+    if (epoll_ctl(child_events_fd, EPOLL_CTL_ADD, sigchld_fd, &ev) == -1
+        || epoll_ctl(child_events_fd, EPOLL_CTL_ADD, sigint_fd, &sigint_ev) == -1)
+        utils_fatal_error("epoll_ctl failed for signalfd: ");
+    struct epoll_event helper_ev = { .events = EPOLLIN, .data.u64 = SPAWN_HELPER_EVENT };
+    if (use_spawn_helper && epoll_ctl(child_events_fd, EPOLL_CTL_ADD, spawn_helper_fd(), &helper_ev) == -1)
+        utils_fatal_error("epoll_ctl failed for spawn helper: ");
 }
 /* Wait for all processes in this job to complete, or for
  * the job no longer to be in the foreground.
@@ -210,25 +723,22 @@ wait_for_job(struct job *job)
 {
     assert(signal_is_blocked(SIGCHLD));
     while (job->status == FOREGROUND && job->num_processes_alive > 0) {
-        int status;
-        pid_t child = waitpid(-1, &status, WUNTRACED);
-        // When called here, any error returned by waitpid indicates a logic
-        // bug in the shell.
-        // In particular, ECHILD "No child process" means that there has
-        // already been a successful waitpid() call that reaped the child, so
-        // there's likely a bug in handle_child_status where it failed to update
-        // the "job" status and/or num_processes_alive fields in the required
-        // fashion.
-        // Since SIGCHLD is blocked, there cannot be races where a child's exit
-        // was handled via the SIGCHLD signal handler.
-        if (child != -1)
-            handle_child_status(child, status);
-        else
-            utils_fatal_error("waitpid failed, see code for explanation");
+        process_child_events(-1);
     }
 }
+/* Tell the wait builtin that a job it waits for finished or stopped */
 static void
-handle_child_status(pid_t pid, int status)
+stop_waiting_for(struct job *job)
+{
+    if (job->waited_for) {
+        job->waited_for = false;
+        num_waited_for--;
+        if (first_waited_done == NULL)
+            first_waited_done = job;
+    }
+}
+static void
+handle_child_status(pid_t pid, int status, const struct rusage *ru)
 {
     assert(signal_is_blocked(SIGCHLD));
     /* To be implemented.
@@ -242,37 +752,40 @@ handle_child_status(pid_t pid, int status)
      * If a process was stopped, save the terminal state.
      */
     // Step 1 determine job with job ID
-    struct job* theJob = NULL;
-    for (struct list_elem* e = list_begin(&job_list); e != list_end(&job_list); e = list_next(e)) {
-        struct job* aJob = list_entry(e, struct job, elem);
-        for (int j = 0; j < MAXJOBS; j++) {
-            if (aJob->pids[j] == pid) {
-                theJob = aJob;
-                break;
-            }
-        }
-    }
-    if (theJob == NULL) {
-        printf("HANDLE CHILD STATUS: JOB NOT FOUND\n");
+    // Processes of deleted jobs and the spawn helper belong to no job
+    struct job* theJob = pid_table_lookup(&pid2job, pid);
+    if (theJob == NULL)
         return;
-    }
+    // Processes that exited report their resource usage
+    if (ru != NULL)
+        rusage_add(&theJob->usage, ru);
+    // The status of a pipeline is that of its last command
+    if (WIFEXITED(status) && pid == theJob->pids[theJob->num_pids - 1])
+        theJob->exit_status = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status) && pid == theJob->pids[theJob->num_pids - 1])
+        theJob->exit_status = 128 + WTERMSIG(status);
+    else if (WIFSTOPPED(status))
+        theJob->exit_status = 128 + WSTOPSIG(status);
     // Step 2 and 3 determine status change and adjust number of processes
     if (WIFEXITED(status)) {
+        pid_table_remove(&pid2job, pid);
         theJob->num_processes_alive--;
         if (theJob->status == FOREGROUND && status == 0) {
             termstate_sample();
         }
-        else if (theJob->status == BACKGROUND) {
-        theJob->status = FINISHED;
+        else if (theJob->status == BACKGROUND && theJob->num_processes_alive == 0) {
+        mark_finished(theJob);
         print_job(theJob);
         }
     } 
     else if (WIFSIGNALED(status)) {
+        pid_table_remove(&pid2job, pid);
         theJob->num_processes_alive--;
-        if (theJob->status == BACKGROUND) {
-            theJob->status = FINISHED;
+        if (theJob->status == BACKGROUND && theJob->num_processes_alive == 0) {
+            mark_finished(theJob);
         }
         int signal = WTERMSIG(status);
+        begin_async_output();
         printf(strsignal(signal)); // Prints what terminated the process
     } 
     else if (WIFSTOPPED(status)) {
@@ -284,6 +797,20 @@ handle_child_status(pid_t pid, int status)
             print_job(theJob);
         }
     }
+    // A job that finished or stopped no longer blocks the wait builtin
+    if (theJob->num_processes_alive == 0 || theJob->status == STOPPED)
+        stop_waiting_for(theJob);
+    if (theJob->num_processes_alive == 0) {
+        release_batch_slot(theJob);
+        timer_heap_remove(&deadlines, &theJob->deadline);
+    }
+    export_job(theJob);
+    if (report_usage && ru != NULL && theJob->num_processes_alive == 0) {
+        begin_async_output();
+        printf("[%d]\t", theJob->jid);
+        rusage_print(stdout, &theJob->usage);
+        printf("\n");
+    }
 }
 
 // Function to implement 'ls' command
@@ -335,16 +862,21 @@ static void cush_bg(char* inpJid) {
         return;
     }
     int jid = atoi(inpJid);
-    struct job* inpJob = get_job_from_jid(jid);
+    struct job* inpJob = get_spawned_job(jid);
     if (inpJob == NULL) {
         printf("bg: %d: no such job\n", jid);
         return;
     }
+    if (inpJob->status == QUEUED) {
+        printf("bg: %d: job has not started\n", jid);
+        return;
+    }
     print_cmdline(inpJob->pipe);
     printf("\n");
     int status = killpg(inpJob->pids[0], SIGCONT);
     if (status == 0) {
         inpJob->status = BACKGROUND;
+        export_job(inpJob);
     }
 }
 /*
@@ -356,11 +888,15 @@ static void cush_fg(char* inpJid) {
         return;
     }
     int jid = atoi(inpJid);
-    struct job* inpJob = get_job_from_jid(jid);
+    struct job* inpJob = get_spawned_job(jid);
     if (inpJob == NULL) {
         printf("fg: %d: no such job\n", jid);
         return;
     }
+    if (inpJob->status == QUEUED) {
+        printf("fg: %d: job has not started\n", jid);
+        return;
+    }
     // call tcsetattr and tcsetpgrp
     tcsetattr(termstate_get_tty_fd(), TCSANOW, &inpJob->saved_tty_state);
     tcsetpgrp(termstate_get_tty_fd(), inpJob->pids[0]);
@@ -369,6 +905,7 @@ static void cush_fg(char* inpJid) {
     int status = killpg(inpJob->pids[0], SIGCONT);
     if (status == 0) {
         inpJob->status = FOREGROUND;
+        export_job(inpJob);
         termstate_give_terminal_to(&inpJob->saved_tty_state, inpJob->pids[0]);
         wait_for_job(inpJob);
         if (inpJob->status == FOREGROUND) {
@@ -391,12 +928,19 @@ static void cush_kill(char* inpJid) {
         return;
     }
     int jid = atoi(inpJid);
-    struct job* inpJob = get_job_from_jid(jid);
+    struct job* inpJob = get_spawned_job(jid);
     if (inpJob == NULL) {
         printf("kill: %d: no such job\n", jid);
         return;
     }
-    int status = killpg(inpJob->pids[0], SIGTERM);
+    if (inpJob->status == QUEUED) { // nothing to signal, just drop it
+        list_remove(&inpJob->elem);
+        delete_job(inpJob);
+        return;
+    }
+    // The cgroup also holds descendants that left the process group
+    int status = inpJob->cgroup_fd != -1 && cgroup_kill(inpJob->cgroup_fd) == 0
+        ? 0 : killpg(inpJob->pids[0], SIGTERM);
     if (status == 0) {
         list_remove(&inpJob->elem);
         delete_job(inpJob);
@@ -411,177 +955,1223 @@ static void cush_stop(char* inpJid) {
         return;
     }
     int jid = atoi(inpJid);
-    struct job* inpJob = get_job_from_jid(jid);
+    struct job* inpJob = get_spawned_job(jid);
     if (inpJob == NULL) {
         printf("stop: %d: no such job\n", jid);
         return;
     }
+    if (inpJob->status == QUEUED) {
+        printf("stop: %d: job has not started\n", jid);
+        return;
+    }
     int status = killpg(inpJob->pids[0], SIGSTOP);
     if (status == 0) {
         if (inpJob->status == FOREGROUND) {
             termstate_save(&inpJob->saved_tty_state);
         }
         inpJob->status = STOPPED;
+        export_job(inpJob);
+    }
+}
+/* True if a job is running in the background or queued to run */
+static bool
+is_pending(struct job *job)
+{
+    return (job->status == BACKGROUND && job->num_processes_alive > 0)
+        || job->status == QUEUED;
+}
+/* Remember the exit status of a finished job that is being deleted */
+static void
+save_deleted_status(struct job *job)
+{
+    if (job->jid >= deleted_statuses_size) {
+        int size = deleted_statuses_size > 0 ? deleted_statuses_size : 64;
+        while (size <= job->jid)
+            size *= 2;
+        int *statuses = realloc(deleted_statuses, size * sizeof *statuses);
+        if (statuses == NULL)
+            utils_fatal_error("cannot allocate job status table: ");
+        for (int i = deleted_statuses_size; i < size; i++)
+            statuses[i] = -1;
+        deleted_statuses = statuses;
+        deleted_statuses_size = size;
+    }
+    deleted_statuses[job->jid] = job->exit_status;
+}
+/* Return and forget the exit status of the deleted job with the
+ * given jid, or return -1 if it is not known */
+static int
+take_deleted_status(int jid)
+{
+    if (jid <= 0 || jid >= deleted_statuses_size)
+        return -1;
+    int status = deleted_statuses[jid];
+    deleted_statuses[jid] = -1;
+    return status;
+}
+/*
+ * Function that implements the wait builtin:
+ *   wait [jid...]     wait until the given jobs, or all running
+ *                     background jobs, have finished
+ *   wait -n [jid...]  wait until any one of them has finished
+ * Job ids may be written as %jid.  Stopped jobs are not waited for,
+ * queued batch jobs are.
+ * Sets last_status to the exit status of the last given job (of the
+ * job that finished for -n, 0 if no job was given), or to 130 if
+ * Ctrl-C ended the wait.  The status of a job that was already deleted
+ * can be waited for once.
+ */
+static void cush_wait(char **argv) {
+    bool wait_any = argv[1] != NULL && strcmp(argv[1], "-n") == 0;
+    char **args = argv + 1 + wait_any;
+    struct job *last = NULL;
+    int status = 0;
+    /* Statuses of given jobs that were already deleted */
+    int last_deleted = 0, first_deleted = -1;
+    num_waited_for = 0;
+    first_waited_done = NULL;
+    // Jobs are waited for through their processes
+    complete_pending_spawns(-1);
+
+    struct job* aJob;
+    if (*args == NULL) {
+        for_each_job(aJob, jid) {
+            if (is_pending(aJob)) {
+                aJob->waited_for = true;
+                num_waited_for++;
+            }
+        }
+    }
+    for (; *args != NULL; args++) {
+        char *inpJid = **args == '%' ? *args + 1 : *args;
+        aJob = get_job_from_jid(atoi(inpJid));
+        if (aJob == NULL && (last_deleted = take_deleted_status(atoi(inpJid))) != -1) {
+            last = NULL;
+            if (first_deleted == -1)
+                first_deleted = last_deleted;
+            continue;
+        }
+        if (aJob == NULL) {
+            printf("wait: %s: no such job\n", *args);
+            status = 127;
+            continue;
+        }
+        last = aJob;
+        if (aJob->waited_for)
+            continue;
+        if (is_pending(aJob)) {
+            aJob->waited_for = true;
+            num_waited_for++;
+        } else if (first_waited_done == NULL) {
+            first_waited_done = aJob;
+        }
+    }
+
+    // Ctrl-C ends the wait; the shell has the terminal meanwhile
+    wait_interrupted = false;
+    signal_block(SIGINT);
+    while (num_waited_for > 0 && !wait_interrupted
+           && !(wait_any && (first_waited_done != NULL || first_deleted != -1)))
+        process_child_events(-1);
+    struct signalfd_siginfo info;
+    while (read(sigint_fd, &info, sizeof info) == sizeof info)
+        wait_interrupted = true;
+    signal_unblock(SIGINT);
+
+    /* wait -n and an interrupted wait leave the jobs that are still running */
+    if (num_waited_for > 0) {
+        for_each_job(aJob, jid)
+            aJob->waited_for = false;
+        num_waited_for = 0;
     }
+
+    if (wait_interrupted) {
+        printf("\n");
+        last_status = 130;
+    } else if (wait_any)
+        last_status = first_waited_done != NULL ? first_waited_done->exit_status
+                    : first_deleted != -1 ? first_deleted : 127;
+    else if (status == 0)
+        last_status = last != NULL ? last->exit_status : last_deleted;
+    else
+        last_status = status;
 }
 /*
  * Removes finished jobs
  */
 static void removeFinishedJobs() {
-    int cnt = 0;
-    int j = 0;
-    while (cnt < list_size(&job_list) && j < MAXJOBS) {
-        struct job* aJob = jid2job[j];
-        if (aJob!= NULL) {
-            if (aJob ->status == FINISHED) {
-                list_remove(&aJob ->elem);
-                delete_job(aJob);
-            }
-            cnt++;
+    while (!list_empty(&finished_jobs)) {
+        struct job *aJob = list_entry(list_front(&finished_jobs), struct job, finished_elem);
+        save_deleted_status(aJob);
+        list_remove(&aJob->elem);
+        delete_job(aJob);
+    }
+}
+/*
+ * Function that implements the jobs command.  With -l, each job is
+ * followed by its resource usage.
+ */
+static void cush_jobs(char *option) {
+    bool long_format = option != NULL && strcmp(option, "-l") == 0;
+    struct job* aJob;
+    for_each_job(aJob, jid) {
+        if (aJob == launching_job)
+            continue;
+        print_job(aJob);
+        if (long_format)
+            print_job_usage(aJob);
+        if (long_format && aJob->cgroup_fd != -1) {
+            printf("\t");
+            cgroup_print_stats(stdout, aJob->cgroup_fd);
+            printf("\n");
         }
-        j++;
     }
 }
 /*
- * Function that implements the jobs command
+ * Return the words of a command after its assignments.  A command of
+ * only assignments runs true, which ignores them, as sh does.
  */
-static void cush_jobs() {
-    int cnt = 0;
-    int i = 0;
-    while (cnt < list_size(&job_list) && i < MAXJOBS) {
-        struct job* aJob = jid2job[i];
-        if (aJob != NULL) {
-            print_job(aJob);
-            cnt++;
+static char **
+command_words(struct ast_command *cmd)
+{
+    static char *no_command[] = { "true", NULL };
+    char **words = cmd->argv + env_table_count_assignments(cmd->argv);
+    return words[0] != NULL ? words : no_command;
+}
+/*
+ * Set up attr and pipeline to spawn the processes of a job's pipeline
+ * into stages, one per command, whose assignments are stored in
+ * assignments.  Only a foreground job is given the terminal.
+ */
+static void
+prepare_spawn(struct job *job, posix_spawnattr_t *attr,
+              struct posix_spawn_pipeline *pipeline, struct posix_spawn_stage *stages,
+              struct env_assignments *assignments)
+{
+    struct ast_pipeline *pipe = job->pipe;
+    struct list *listCommands = &pipe->commands;
+    int flags = POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK;
+    if (job->status == FOREGROUND)
+        flags |= POSIX_SPAWN_TCSETPGROUP;
+    if (job->cgroup_fd != -1)
+        flags |= POSIX_SPAWN_SETCGROUP;
+    if (use_pidfds)
+        flags |= POSIX_SPAWN_PIDFD;
+    if (job->sched != NULL)
+        flags |= job->sched->flags;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    job->start_time = now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+    posix_spawnattr_init(attr);
+    // The shell keeps SIGCHLD blocked; children start with nothing blocked
+    sigset_t emptymask;
+    sigemptyset(&emptymask);
+    posix_spawnattr_setsigmask(attr, &emptymask);
+    posix_spawnattr_setflags(attr, flags);
+    posix_spawnattr_setpgroup(attr, 0);
+    posix_spawnattr_tcsetpgrp_np(attr, termstate_get_tty_fd());
+    posix_spawnattr_setcgroup_np(attr, job->cgroup_fd);
+    if (job->sched != NULL) {
+        struct job_sched *sched = job->sched;
+        posix_spawnattr_setaffinity_np(attr, sizeof sched->cpus, &sched->cpus);
+        posix_spawnattr_setnice_np(attr, sched->nice);
+        posix_spawnattr_setschedpolicy(attr, sched->policy);
+        struct sched_param param = {
+            .sched_priority = sched->policy == SCHED_FIFO || sched->policy == SCHED_RR
+                              ? sched_get_priority_min(sched->policy) : 0
+        };
+        posix_spawnattr_setschedparam(attr, &param);
+        posix_spawnattr_setioprio_np(attr, sched->ioprio);
+    }
+    struct job_rlimits *rlimits = job->rlimits != NULL ? job->rlimits : &shell_rlimits;
+    posix_spawnattr_setrlimit_np(attr, rlimits->mask, rlimits->limits);
+    // Commands without a '/' are looked up through the path cache,
+    // and searched for again if they went away.  A PATH assignment in
+    // front of a command changes where it is searched for, so the
+    // child searches the PATH it is given instead.
+    int nstages = list_size(listCommands);
+    int cnt = 0; // Counter for command index
+    for (struct list_elem *f = list_begin(listCommands); f != list_end(listCommands); f = list_next(f)) {
+        struct ast_command *cmd = list_entry(f, struct ast_command, elem);
+        char **argv = command_words(cmd);
+        assignments[cnt] = (struct env_assignments) {
+            .words = cmd->argv,
+            .n = env_table_count_assignments(cmd->argv)
+        };
+        bool assigns_path = false;
+        for (int i = 0; i < assignments[cnt].n; i++)
+            assigns_path |= strncmp(cmd->argv[i], "PATH=", 5) == 0;
+        const char *path = argv[0], *file = NULL;
+        if (strchr(argv[0], '/') == NULL && assigns_path) {
+            path = NULL;
+            file = argv[0];
+        } else if (strchr(argv[0], '/') == NULL) {
+            path = path_cache_lookup(argv[0]);
+            file = path != NULL ? argv[0] : NULL;
         }
-        i++;
+        struct builtin_output *output = job->builtin_outputs != NULL
+                                        && job->builtin_outputs[cnt].path[0] != '\0'
+                                        ? &job->builtin_outputs[cnt] : NULL;
+        stages[cnt++] = (struct posix_spawn_stage) {
+            .path = path,
+            .file = file,
+            .argv = argv,
+            .dup_stderr = cmd->dup_stderr_to_stdout,
+            .builtin_output = output != NULL ? output->path : NULL
+        };
     }
+    *pipeline = (struct posix_spawn_pipeline) {
+        .stages = stages,
+        .nstages = nstages,
+        .input = pipe->iored_input,
+        .output = pipe->iored_output,
+        .output_append = pipe->append_to_output,
+        .output_mode = 0777,
+        .nworkers = nstages >= PARALLEL_SPAWN_MIN_STAGES ? spawn_workers : 1
+    };
 }
 /*
-* This function interprets the command line entered and calls the cush  * functions corresponding to it
+ * Add the processes spawned for a job's stages to it.  Returns 0, or
+ * the error code of a command that could not be spawned.
  */
-static void interpret(struct ast_command_line *inpCmdLine) {
-    signal_block(SIGCHLD); //signal to prevent race condition
-    struct list *listPipe = &inpCmdLine->pipes;
-    for (struct list_elem *e = list_begin(listPipe); e != list_end(listPipe);) {
-        struct ast_pipeline *pipe = list_entry(e, struct ast_pipeline, elem);
-        e = list_remove(e); // Remove to stop double processing
-        int returnCode = 0;
-        struct list *listCommands = &pipe->commands; 
-        struct job *job = NULL;
-        // Create pipes for processes
-        int size = list_size(listCommands) - 1;
-        if (size == 0) size++;
-        int pipeArray[size][2]; // Array for file descriptors
-        int cnt = 0; // Counter for command index
-        for (struct list_elem *f = list_begin(listCommands); f != list_end(listCommands); f = list_next(f)) {
-            struct ast_command *cmd = list_entry(f, struct ast_command, elem);
-            char *inpCmd = cmd->argv[0];
-            if (strcmp(inpCmd, "exit") == 0) {
-                exit(0);
-            } else if (strcmp(inpCmd, "bg") == 0) {
-                cush_bg(cmd->argv[1]);
-            } else if (strcmp(inpCmd, "ls") == 0) {
-                cush_ls();
-            } else if (strcmp(inpCmd, "pwd") == 0) {
-                cush_pwd();
-            } else if (strcmp(inpCmd, "history") == 0) {
-                cush_history();
-            } else if (strcmp(inpCmd, "fg") == 0) {
-                cush_fg(cmd->argv[1]);
-            } else if (strcmp(inpCmd, "kill") == 0) {
-                cush_kill(cmd->argv[1]);
-            } else if (strcmp(inpCmd, "stop") == 0) {
-                cush_stop(cmd->argv[1]);
-            } else if (strcmp(inpCmd, "jobs") == 0) {
-                cush_jobs();
-            } else {
-                posix_spawn_file_actions_t spawn_child_file;
-                posix_spawnattr_t spawn_child_attr;
-                posix_spawnattr_init(&spawn_child_attr);
-                posix_spawn_file_actions_init(&spawn_child_file);
-                if (f == list_begin(listCommands)) {
-                    job = add_job(pipe);
-                    posix_spawnattr_setflags(&spawn_child_attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_TCSETPGROUP);
-                    posix_spawnattr_setpgroup(&spawn_child_attr, 0);
-                    posix_spawnattr_tcsetpgrp_np(&spawn_child_attr, termstate_get_tty_fd());
-                    if (pipe->iored_input != NULL) {
-                        posix_spawn_file_actions_addopen(&spawn_child_file, 0, pipe->iored_input, O_RDONLY, 0777);
-                    }
-                } else {
-                    posix_spawnattr_setflags(&spawn_child_attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_TCSETPGROUP);
-                    posix_spawnattr_setpgroup(&spawn_child_attr, job->pids[0]);
-                    posix_spawnattr_tcsetpgrp_np(&spawn_child_attr, termstate_get_tty_fd());
-                }
-                if (f == list_rbegin(listCommands)) {
-                    if (pipe->append_to_output) {
-                        posix_spawn_file_actions_addopen(&spawn_child_file, 1, pipe->iored_output, O_WRONLY | O_APPEND | O_CREAT, 0777);
-                    } else if (pipe->iored_output != NULL) {
-                        posix_spawn_file_actions_addopen(&spawn_child_file, 1, pipe->iored_output, O_WRONLY | O_TRUNC | O_CREAT, 0777);
-                    }
-                }
-                // Pipe the commands
-                if (f == list_begin(listCommands) && f != list_rbegin(listCommands)) {
-                    pipe2(pipeArray[cnt], O_CLOEXEC);
-                    posix_spawn_file_actions_adddup2(&spawn_child_file, pipeArray[cnt][PIPE_WRITE], STDOUT_FILENO);
-                } else if (f != list_begin(listCommands) && f != list_rbegin(listCommands)) {
-                    posix_spawn_file_actions_adddup2(&spawn_child_file, pipeArray[cnt][PIPE_WRITE], STDOUT_FILENO);
-                    posix_spawn_file_actions_adddup2(&spawn_child_file, pipeArray[cnt - 1][PIPE_READ], STDIN_FILENO);
-                } else if (f != list_begin(listCommands) && f == list_rbegin(listCommands)) {
-                    posix_spawn_file_actions_adddup2(&spawn_child_file, pipeArray[cnt - 1][PIPE_READ], STDIN_FILENO);
-                }
-                if (cmd->dup_stderr_to_stdout) {
-                    posix_spawn_file_actions_adddup2(&spawn_child_file, STDOUT_FILENO, STDERR_FILENO);
-                }
-                // Spawn the child process
-                pid_t childPID;
-                extern char **environ;
-                returnCode = posix_spawnp(&childPID, inpCmd, &spawn_child_file, &spawn_child_attr, cmd->argv, environ);
-                if (returnCode == 0) {
-                    // Add child
-                    int index = findEmptyPIDSlot(job);
-                    job->pids[index] = childPID;
-                    job->num_processes_alive++;
-                    if (pipe->bg_job) {
-                        job->status = BACKGROUND;
-                        printf("[%u] %u\n", job->jid, childPID);
-                        tcgetattr(termstate_get_tty_fd(), &job->saved_tty_state);
-                    }
-                }
-                posix_spawn_file_actions_destroy(&spawn_child_file);
-                posix_spawnattr_destroy(&spawn_child_attr);
+static int
+add_stages_to_job(struct job *job, struct posix_spawn_stage *stages)
+{
+    int returnCode = 0;
+    int i = 0;
+    struct list *listCommands = &job->pipe->commands;
+    for (struct list_elem *f = list_begin(listCommands); f != list_end(listCommands); f = list_next(f), i++) {
+        struct ast_command *cmd = list_entry(f, struct ast_command, elem);
+        if (stages[i].searched)     // the cached path is stale
+            path_cache_forget(command_words(cmd)[0]);
+        if (stages[i].err != 0) {
+            if (returnCode == 0)
+                returnCode = stages[i].err;
+            // The helper cannot reap what it failed to spawn; it has
+            // exited by the time the helper replies
+            if (stages[i].pid != 0 && stages[i].pidfd != -1) {
+                waitid(P_PIDFD, stages[i].pidfd, &(siginfo_t) { .si_pid = 0 }, WEXITED);
+                close(stages[i].pidfd);
+            } else if (stages[i].pid != 0) {
+                waitpid(stages[i].pid, NULL, 0);
             }
-            
-            cnt++;
+        } else if (stages[i].pid != 0) {    // not a builtin
+            add_pid_to_job(job, stages[i].pid, stages[i].pidfd);
         }
-        if (list_size(listCommands) > 1) {
-            for (int i = 0; i < size; i++) {
-                for (int j = 0; j < 2; j++) {
-                    close(pipeArray[i][j]);
-                }
+    }
+    release_builtin_outputs(job);
+    return returnCode;
+}
+/*
+ * Send a background job to the spawn helper, first collecting replies
+ * if too many are outstanding.  Returns false if the helper cannot
+ * take it.
+ */
+static bool
+submit_job(struct job *job)
+{
+    int nstages = list_size(&job->pipe->commands);
+    while (!spawn_helper_has_room(nstages) && !list_empty(&pending_spawns))
+        complete_pending_spawns(1);
+    struct posix_spawn_stage stages[nstages];
+    struct env_assignments assignments[nstages];
+    posix_spawnattr_t attr;
+    struct posix_spawn_pipeline pipeline;
+    prepare_spawn(job, &attr, &pipeline, stages, assignments);
+    int rc = spawn_helper_submit(&pipeline, &attr, assignments);
+    posix_spawnattr_destroy(&attr);
+    if (rc != 0)
+        return false;
+    list_push_back(&pending_spawns, &job->queue_elem);
+    job->spawn_pending = true;
+    return true;
+}
+/*
+ * Spawn the processes of a job's pipeline and wait until they are
+ * started.  Returns 0, or the error code of a command that could not
+ * be spawned; the other commands are spawned regardless.
+ */
+static int
+spawn_job(struct job *job)
+{
+    int nstages = list_size(&job->pipe->commands);
+    struct posix_spawn_stage stages[nstages];
+    struct env_assignments assignments[nstages];
+    posix_spawnattr_t attr;
+    struct posix_spawn_pipeline pipeline;
+    prepare_spawn(job, &attr, &pipeline, stages, assignments);
+    // Replies come in order, so earlier jobs are collected first
+    complete_pending_spawns(-1);
+    if (use_spawn_helper && spawn_helper_submit(&pipeline, &attr, assignments) == 0) {
+        spawn_helper_complete(&pipeline);
+    } else {
+        posix_spawn_pipeline_np(&pipeline, &attr,
+                                env_table_begin_spawn(&pipeline, assignments));
+        env_table_end_spawn(&pipeline);
+    }
+    posix_spawnattr_destroy(&attr);
+    return add_stages_to_job(job, stages);
+}
+/* Start queued batch jobs while fewer than batch_limit are running */
+static void
+dispatch_batch_jobs(void)
+{
+    while (num_batch_running < batch_limit && !list_empty(&batch_queue)) {
+        struct job *job = list_entry(list_pop_front(&batch_queue), struct job, queue_elem);
+        job->status = BACKGROUND;
+        job->holds_batch_slot = true;
+        num_batch_running++;
+        run_pipeline_builtins(job);
+        if (spawn_job(job) != 0) {
+            begin_async_output();
+            printf("[%d] no such file or directory\n", job->jid);
+        }
+        if (job->num_processes_alive == 0) {
+            mark_finished(job);
+            release_batch_slot(job);
+            stop_waiting_for(job);
+        }
+    }
+}
+/* Remove the first n arguments from a command's argv */
+static void
+remove_args(char **argv, int n)
+{
+    int argc = n;
+    while (argv[argc] != NULL)
+        argc++;
+    for (int i = 0; i < n; i++)
+        free(argv[i]);
+    memmove(argv, argv + n, (argc - n + 1) * sizeof *argv);
+}
+/*
+ * Function that implements the batch command:
+ *   batch [-j N] [cmd ...]
+ * queues the pipeline cmd ... to run in the background once fewer
+ * than N batch jobs are running.  -j sets the limit for this and all
+ * later batch jobs (initially the number of CPUs); without a command,
+ * batch only sets the limit, or reports it.
+ * Takes ownership of pipe.
+ */
+static void cush_batch(struct ast_pipeline *pipe) {
+    struct ast_command *cmd = list_entry(list_begin(&pipe->commands), struct ast_command, elem);
+    char **argv = cmd->argv;
+    int skip = 1;
+    if (argv[1] != NULL && strcmp(argv[1], "-j") == 0) {
+        int limit = argv[2] != NULL ? atoi(argv[2]) : 0;
+        if (limit < 1) {
+            printf("batch: -j requires a positive number\n");
+            ast_pipeline_free(pipe);
+            return;
+        }
+        batch_limit = limit;
+        skip = 3;
+    }
+    // Strip the batch prefix, leaving the command to run
+    remove_args(argv, skip);
+
+    if (argv[0] == NULL) {
+        if (skip == 1)
+            printf("batch: %d running, %zu queued, limit %d\n",
+                   num_batch_running, list_size(&batch_queue), batch_limit);
+        ast_pipeline_free(pipe);
+        return;
+    }
+    struct job *job = add_job(pipe);
+    job->status = QUEUED;
+    export_job(job);
+    list_push_back(&batch_queue, &job->queue_elem);
+    printf("[%d] queued\n", job->jid);
+}
+/*
+ * Function that implements the hash builtin:
+ *   hash              list the cached command locations
+ *   hash -r           forget all of them
+ *   hash -d name...   forget the given commands
+ *   hash name...      look up the given commands and cache them
+ */
+static void cush_hash(char **argv) {
+    if (argv[1] == NULL) {
+        path_cache_print(stdout);
+    } else if (strcmp(argv[1], "-r") == 0) {
+        path_cache_clear();
+    } else if (strcmp(argv[1], "-d") == 0) {
+        for (char **name = argv + 2; *name != NULL; name++)
+            if (path_cache_forget(*name) == -1)
+                printf("hash: %s: not found\n", *name);
+    } else {
+        path_cache_revalidate();
+        for (char **name = argv + 1; *name != NULL; name++)
+            if (strchr(*name, '/') == NULL && path_cache_lookup(*name) == NULL)
+                printf("hash: %s: not found\n", *name);
+    }
+}
+/*
+ * Function that implements the export builtin:
+ *   export                 list the exported variables
+ *   export NAME=value...   set and export variables
+ * Every variable the shell knows is exported, so export NAME does
+ * nothing.
+ */
+static void cush_export(char **argv) {
+    if (argv[1] == NULL)
+        env_table_print(stdout);
+    for (char **word = argv + 1; *word != NULL; word++)
+        if (!env_table_set(*word, true) && strchr(*word, '=') != NULL)
+            printf("export: %s: not a valid identifier\n", *word);
+    // Commands later on the line are looked up on the new PATH
+    path_cache_revalidate();
+}
+/*
+ * Function that implements the unset builtin:
+ *   unset NAME...   remove variables from the environment
+ */
+static void cush_unset(char **argv) {
+    for (char **name = argv + 1; *name != NULL; name++)
+        env_table_unset(*name);
+    path_cache_revalidate();
+}
+/* True if cmd runs the ls builtin.  It lists only the current
+ * directory, so ls with arguments runs the real ls, as does ls with
+ * assignments in front of it, which may change where it is found. */
+static bool
+is_ls_builtin(struct ast_command *cmd)
+{
+    return strcmp(cmd->argv[0], "ls") == 0 && cmd->argv[1] == NULL;
+}
+/*
+ * Run a builtin command.  Returns false if cmd is not a builtin.
+ * Assignments in front of a builtin are ignored; without a command,
+ * they change variables that are already exported.
+ */
+static bool run_builtin(struct ast_command *cmd) {
+    int nassignments = env_table_count_assignments(cmd->argv);
+    char **argv = cmd->argv + nassignments;
+    if (argv[0] == NULL) {
+        for (int i = 0; i < nassignments; i++)
+            env_table_set(cmd->argv[i], false);
+        return true;
+    }
+    char *inpCmd = argv[0];
+    if (strcmp(inpCmd, "exit") == 0) {
+        last_status = argv[1] != NULL ? atoi(argv[1]) : 0;
+        shell_exiting = true;
+    } else if (strcmp(inpCmd, "bg") == 0) {
+        cush_bg(argv[1]);
+    } else if (is_ls_builtin(cmd)) {
+        cush_ls();
+    } else if (strcmp(inpCmd, "pwd") == 0) {
+        cush_pwd();
+    } else if (strcmp(inpCmd, "history") == 0) {
+        cush_history();
+    } else if (strcmp(inpCmd, "fg") == 0) {
+        cush_fg(argv[1]);
+    } else if (strcmp(inpCmd, "kill") == 0) {
+        cush_kill(argv[1]);
+    } else if (strcmp(inpCmd, "stop") == 0) {
+        cush_stop(argv[1]);
+    } else if (strcmp(inpCmd, "jobs") == 0) {
+        cush_jobs(argv[1]);
+    } else if (strcmp(inpCmd, "wait") == 0) {
+        cush_wait(argv);
+    } else if (strcmp(inpCmd, "hash") == 0) {
+        cush_hash(argv);
+    } else if (strcmp(inpCmd, "export") == 0) {
+        cush_export(argv);
+    } else if (strcmp(inpCmd, "unset") == 0) {
+        cush_unset(argv);
+    } else {
+        return false;
+    }
+    return true;
+}
+/* Builtins that only print, and so may be commands of a pipeline and
+ * have their output redirected */
+static bool
+is_output_builtin(struct ast_command *cmd)
+{
+    static const char *names[] = { "jobs", "history", "pwd" };
+    for (int i = 0; i < sizeof names / sizeof names[0]; i++)
+        if (strcmp(command_words(cmd)[0], names[i]) == 0)
+            return true;
+    return is_ls_builtin(cmd);
+}
+/* Run a builtin with its output going to fd */
+static void
+run_builtin_to(struct ast_command *cmd, int fd)
+{
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    if (saved_stdout == -1 || dup2(fd, STDOUT_FILENO) == -1) {
+        utils_error("cannot redirect output of %s: ", command_words(cmd)[0]);
+        if (saved_stdout != -1)
+            close(saved_stdout);
+        return;
+    }
+    run_builtin(cmd);
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+}
+/*
+ * Run the builtins among the commands of a job, in the shell, before
+ * its other commands are spawned.  The output of a builtin is kept in
+ * a memfd, which the command after it opens through /proc as its
+ * input, so no process is needed for the builtin and none needs to
+ * copy its output.  The last command writes to the job's output file,
+ * if any, directly.  The input of a builtin is not read.
+ */
+static void
+run_pipeline_builtins(struct job *job)
+{
+    struct ast_pipeline *pipe = job->pipe;
+    int nstages = list_size(&pipe->commands);
+    int i = 0;
+    launching_job = job;
+    for (struct list_elem *e = list_begin(&pipe->commands); e != list_end(&pipe->commands);
+            e = list_next(e), i++) {
+        struct ast_command *cmd = list_entry(e, struct ast_command, elem);
+        if (!is_output_builtin(cmd))
+            continue;
+        if (job->builtin_outputs == NULL) {
+            job->builtin_outputs = calloc(nstages, sizeof *job->builtin_outputs);
+            if (job->builtin_outputs == NULL)
+                utils_fatal_error("cannot allocate job: ");
+            for (int j = 0; j < nstages; j++)
+                job->builtin_outputs[j].fd = -1;
+        }
+        struct builtin_output *output = &job->builtin_outputs[i];
+        if (i < nstages - 1) {
+            output->fd = memfd_create(command_words(cmd)[0], MFD_CLOEXEC);
+            if (output->fd == -1) {
+                utils_error("cannot keep output of %s: ", command_words(cmd)[0]);
+                snprintf(output->path, sizeof output->path, "/dev/null");
+                continue;
+            }
+            run_builtin_to(cmd, output->fd);
+            snprintf(output->path, sizeof output->path, "/proc/%d/fd/%d",
+                     getpid(), output->fd);
+        } else {
+            // Nothing reads the file; the path only marks the command as run
+            snprintf(output->path, sizeof output->path, "/dev/null");
+            int fd = pipe->iored_output == NULL ? STDOUT_FILENO
+                     : open(pipe->iored_output, O_WRONLY | O_CREAT | O_CLOEXEC
+                            | (pipe->append_to_output ? O_APPEND : O_TRUNC), 0777);
+            if (fd == -1) {
+                utils_error("%s: ", pipe->iored_output);
+            } else if (fd == STDOUT_FILENO) {
+                begin_async_output();   // a batch job may start at the prompt
+                run_builtin(cmd);
+            } else {
+                run_builtin_to(cmd, fd);
+                close(fd);
             }
         }
-        // If returnCode isn't zero, that means POSIX_SPAWN provided an error code
-        if (returnCode != 0) {
-            printf("no such file or directory\n");
+    }
+    launching_job = NULL;
+}
+/*
+ * Finish starting a job once its processes were spawned, which failed
+ * with returnCode if nonzero, and wait for it unless it runs in the
+ * background.
+ */
+static void job_spawned(struct job *job, int returnCode) {
+    // If returnCode is nonzero, POSIX_SPAWN provided an error code
+    if (returnCode != 0) {
+        begin_async_output();
+        printf("%s\n", returnCode == ENOENT ? "no such file or directory" : strerror(returnCode));
+        last_status = 127;
+    }
+    if (job->num_processes_alive == 0) {
+        list_remove(&job->elem);
+        delete_job(job);
+    } else if (job->status == BACKGROUND) {
+        begin_async_output();
+        printf("[%u] %u\n", job->jid, job->pids[0]);
+        tcgetattr(termstate_get_tty_fd(), &job->saved_tty_state);
+    } else {
+        // Wait for foreground job status
+        wait_for_job(job);
+        last_status = job->exit_status;
+        if (job->status == FOREGROUND) {
             list_remove(&job->elem);
             delete_job(job);
         }
-        // Wait for foreground job status
-        else if (job != NULL && job->status == FOREGROUND) {
-            wait_for_job(job);
-            if (job->status == FOREGROUND) {
-                list_remove(&job->elem);
-                delete_job(job);
-            }
+    }
+}
+/*
+ * Collect the spawn helper's replies for up to max (all if -1) of the
+ * jobs in pending_spawns, waiting for them if need be.
+ */
+static void complete_pending_spawns(int max) {
+    while (max-- != 0 && !list_empty(&pending_spawns)) {
+        struct job *job = list_entry(list_pop_front(&pending_spawns), struct job, queue_elem);
+        job->spawn_pending = false;
+        int nstages = list_size(&job->pipe->commands);
+        struct posix_spawn_stage stages[nstages];
+        struct posix_spawn_pipeline pipeline = { .stages = stages, .nstages = nstages };
+        spawn_helper_complete(&pipeline);
+        job_spawned(job, add_stages_to_job(job, stages));
+    }
+}
+/* Collect the replies the spawn helper has sent, without waiting */
+static void collect_spawn_replies(void) {
+    while (!list_empty(&pending_spawns)) {
+        struct job *job = list_entry(list_front(&pending_spawns), struct job, queue_elem);
+        if (!spawn_helper_reply_ready(list_size(&job->pipe->commands)))
+            break;
+        complete_pending_spawns(1);
+    }
+}
+/* Return the job with the given jid, or NULL, once the spawn helper's
+ * reply for it is collected and it has its processes.  The job is
+ * deleted then if none of them could be spawned. */
+static struct job *
+get_spawned_job(int jid)
+{
+    struct job *job;
+    while ((job = get_job_from_jid(jid)) != NULL && job->spawn_pending)
+        complete_pending_spawns(1);
+    return job;
+}
+/*
+ * Start a new job and wait for it unless it runs in the background.
+ * With the spawn helper, a background job is only started once the
+ * helper's reply is collected.
+ */
+static void launch_job(struct job *job) {
+    job->status = job->pipe->bg_job ? BACKGROUND : FOREGROUND;
+    run_pipeline_builtins(job);
+    if (job->status == BACKGROUND && use_spawn_helper && submit_job(job))
+        return;
+    job_spawned(job, spawn_job(job));
+}
+/*
+ * Start a job for a pipeline of external commands.  Takes ownership
+ * of pipe.
+ */
+static void run_job(struct ast_pipeline *pipe) {
+    launch_job(add_job(pipe));
+}
+/* Set a cgroup limit of a job, reporting failure */
+static bool
+set_cgroup_limit(struct job *job, const char *name, const char *value)
+{
+    if (cgroup_write(job->cgroup_fd, name, value) == 0)
+        return true;
+    utils_error("cgroup: cannot set %s to %s: ", name, value);
+    return false;
+}
+/*
+ * Function that implements the cgroup command:
+ *   cgroup [-m MEM] [-c CPU] cmd ...
+ *   cgroup [-m MEM] [-c CPU] %jid
+ * runs the pipeline cmd ..., or updates the running job jid, with the
+ * given memory.max (e.g. 512M) and cpu.max, which is either a
+ * percentage of one CPU (e.g. 50%) or a value such as "max".
+ * Requires -c.  Takes ownership of pipe.
+ */
+static void cush_cgroup(struct ast_pipeline *pipe) {
+    struct ast_command *cmd = list_entry(list_begin(&pipe->commands), struct ast_command, elem);
+    char **argv = cmd->argv;
+    char *memory_max = NULL, *cpu_arg = NULL;
+    int skip = 1;
+    for (; argv[skip] != NULL && argv[skip + 1] != NULL; skip += 2) {
+        if (strcmp(argv[skip], "-m") == 0)
+            memory_max = argv[skip + 1];
+        else if (strcmp(argv[skip], "-c") == 0)
+            cpu_arg = argv[skip + 1];
+        else
+            break;
+    }
+    if (!use_cgroups || argv[skip] == NULL) {
+        printf(!use_cgroups ? "cgroup: jobs have no cgroups (start cush with -c)\n"
+                            : "usage: cgroup [-m MEM] [-c CPU] cmd ... | %%jid\n");
+        ast_pipeline_free(pipe);
+        return;
+    }
+    char cpu_max[32];
+    if (cpu_arg != NULL) {
+        int percent;
+        char percent_sign;
+        if (sscanf(cpu_arg, "%d%c", &percent, &percent_sign) == 2 && percent_sign == '%' && percent > 0)
+            snprintf(cpu_max, sizeof cpu_max, "%d 100000", percent * 1000);
+        else
+            snprintf(cpu_max, sizeof cpu_max, "%s", cpu_arg);
+    }
+
+    // Update a running job
+    struct job *job;
+    if (argv[skip][0] == '%') {
+        job = get_job_from_jid(atoi(argv[skip] + 1));
+        if (job == NULL || job->cgroup_fd == -1)
+            printf("cgroup: %s: no such job\n", argv[skip]);
+        else {
+            if (memory_max != NULL)
+                set_cgroup_limit(job, "memory.max", memory_max);
+            if (cpu_arg != NULL)
+                set_cgroup_limit(job, "cpu.max", cpu_max);
+        }
+        ast_pipeline_free(pipe);
+        return;
+    }
+
+    // Start a new job with the limits in place
+    job = add_job(pipe);
+    if (job->cgroup_fd == -1
+            || (memory_max != NULL && !set_cgroup_limit(job, "memory.max", memory_max))
+            || (cpu_arg != NULL && !set_cgroup_limit(job, "cpu.max", cpu_max))) {
+        list_remove(&job->elem);
+        delete_job(job);
+        return;
+    }
+    remove_args(argv, skip);
+    launch_job(job);
+}
+/* Parse a duration such as 10, 1.5s, 2m, 1h or 1d into ms */
+static bool
+parse_duration(const char *arg, long long *ms)
+{
+    char *end;
+    double value = strtod(arg, &end);
+    double unit = strcmp(end, "") == 0 || strcmp(end, "s") == 0 ? 1000
+                : strcmp(end, "m") == 0 ? 60 * 1000
+                : strcmp(end, "h") == 0 ? 3600 * 1000
+                : strcmp(end, "d") == 0 ? 86400 * 1000 : -1;
+    if (end == arg || unit < 0 || !(value >= 0))
+        return false;
+    *ms = value * unit;
+    return true;
+}
+/* Parse a signal given by number or name (TERM or SIGTERM), or return -1 */
+static int
+parse_signal(const char *arg)
+{
+    if (arg[0] >= '0' && arg[0] <= '9') {
+        int sig = atoi(arg);
+        return sig > 0 && sig < NSIG ? sig : -1;
+    }
+    if (strncmp(arg, "SIG", 3) == 0)
+        arg += 3;
+    for (int sig = 1; sig < NSIG; sig++) {
+        const char *name = sigabbrev_np(sig);
+        if (name != NULL && strcmp(name, arg) == 0)
+            return sig;
+    }
+    return -1;
+}
+/*
+ * Function that implements the timeout command:
+ *   timeout [-s SIG] [-k GRACE] DURATION cmd ...
+ * runs the pipeline cmd ..., in the foreground or, with &, in the
+ * background, and sends it SIG (default TERM) once DURATION has
+ * passed, followed by SIGKILL after GRACE (default 5s).  Durations
+ * are in seconds unless suffixed with m, h or d.
+ * Takes ownership of pipe.
+ */
+static void cush_timeout(struct ast_pipeline *pipe) {
+    struct ast_command *cmd = list_entry(list_begin(&pipe->commands), struct ast_command, elem);
+    char **argv = cmd->argv;
+    int sig = SIGTERM;
+    long long grace = 5000, duration;
+    int skip = 1;
+    for (; argv[skip] != NULL && argv[skip + 1] != NULL; skip += 2) {
+        if (strcmp(argv[skip], "-s") == 0)
+            sig = parse_signal(argv[skip + 1]);
+        else if (strcmp(argv[skip], "-k") == 0 && !parse_duration(argv[skip + 1], &grace))
+            grace = -1;
+        else if (strcmp(argv[skip], "-k") != 0)
+            break;
+    }
+    if (sig == -1 || grace < 0 || argv[skip] == NULL || argv[skip + 1] == NULL
+            || !parse_duration(argv[skip], &duration)) {
+        printf("usage: timeout [-s SIG] [-k GRACE] DURATION cmd ...\n");
+        ast_pipeline_free(pipe);
+        return;
+    }
+    remove_args(argv, skip + 1);
+
+    struct job *job = add_job(pipe);
+    job->timeout = TIMEOUT_PENDING;
+    job->timeout_signal = sig;
+    job->timeout_grace = grace;
+    timer_heap_add(&deadlines, &job->deadline, now_ms() + duration);
+    launch_job(job);
+}
+/* Parse a list of CPUs such as 0-3,6 */
+static bool
+parse_cpu_list(const char *arg, cpu_set_t *cpus)
+{
+    CPU_ZERO(cpus);
+    while (*arg != '\0') {
+        char *end;
+        long first = strtol(arg, &end, 10), last = first;
+        if (end != arg && *end == '-') {
+            arg = end + 1;
+            last = strtol(arg, &end, 10);
+        }
+        if (end == arg || first < 0 || last < first || last >= CPU_SETSIZE
+                || (*end != ',' && *end != '\0'))
+            return false;
+        for (long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, cpus);
+        arg = *end == ',' ? end + 1 : end;
+    }
+    return CPU_COUNT(cpus) > 0;
+}
+/* Parse a scheduling policy name, or return -1 */
+static int
+parse_sched_policy(const char *arg)
+{
+    static const struct {
+        const char *name;
+        int policy;
+    } policies[] = {
+        { "other", SCHED_OTHER }, { "batch", SCHED_BATCH }, { "idle", SCHED_IDLE },
+        { "fifo", SCHED_FIFO }, { "rr", SCHED_RR },
+    };
+    for (int i = 0; i < sizeof policies / sizeof policies[0]; i++)
+        if (strcmp(arg, policies[i].name) == 0)
+            return policies[i].policy;
+    return -1;
+}
+/* Parse an I/O priority such as idle, be or rt:0, or return -1 */
+static int
+parse_ioprio(const char *arg)
+{
+    int level = 4;
+    const char *colon = strchr(arg, ':');
+    size_t len = colon != NULL ? colon - arg : strlen(arg);
+    if (colon != NULL) {
+        char *end;
+        level = strtol(colon + 1, &end, 10);
+        if (end == colon + 1 || *end != '\0' || level < 0 || level > 7)
+            return -1;
+    }
+    if (len == 4 && strncmp(arg, "idle", len) == 0 && colon == NULL)
+        return IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0);
+    if (len == 2 && strncmp(arg, "be", len) == 0)
+        return IOPRIO_PRIO_VALUE(IOPRIO_CLASS_BE, level);
+    if (len == 2 && strncmp(arg, "rt", len) == 0)
+        return IOPRIO_PRIO_VALUE(IOPRIO_CLASS_RT, level);
+    return -1;
+}
+/*
+ * Function that implements the run command:
+ *   run [--cpus LIST] [--nice N] [--sched POLICY] [--ioprio CLASS[:LEVEL]] [--] cmd ...
+ * runs the pipeline cmd ..., in the foreground or, with &, in the
+ * background, with all its processes restricted to the CPUs in LIST
+ * (e.g. 0-3,6), at nice value N, under scheduling policy POLICY
+ * (other, batch, idle, fifo or rr), and with I/O priority CLASS (idle,
+ * be or rt) at LEVEL 0-7 (default 4).
+ * Takes ownership of pipe.
+ */
+static void cush_run(struct ast_pipeline *pipe) {
+    struct ast_command *cmd = list_entry(list_begin(&pipe->commands), struct ast_command, elem);
+    char **argv = cmd->argv;
+    struct job_sched sched = { .flags = 0 };
+    bool ok = true;
+    int skip = 1;
+    for (; ok && argv[skip] != NULL && argv[skip + 1] != NULL; skip += 2) {
+        const char *value = argv[skip + 1];
+        char *end;
+        if (strcmp(argv[skip], "--cpus") == 0) {
+            ok = parse_cpu_list(value, &sched.cpus);
+            sched.flags |= POSIX_SPAWN_SETAFFINITY;
+        } else if (strcmp(argv[skip], "--nice") == 0) {
+            sched.nice = strtol(value, &end, 10);
+            ok = end != value && *end == '\0' && sched.nice >= -20 && sched.nice <= 19;
+            sched.flags |= POSIX_SPAWN_SETNICE;
+        } else if (strcmp(argv[skip], "--sched") == 0) {
+            ok = (sched.policy = parse_sched_policy(value)) != -1;
+            sched.flags |= POSIX_SPAWN_SETSCHEDULER;
+        } else if (strcmp(argv[skip], "--ioprio") == 0) {
+            ok = (sched.ioprio = parse_ioprio(value)) != -1;
+            sched.flags |= POSIX_SPAWN_SETIOPRIO;
+        } else {
+            break;
+        }
+    }
+    if (ok && argv[skip] != NULL && strcmp(argv[skip], "--") == 0)
+        skip++;
+    if (!ok || argv[skip] == NULL) {
+        printf("usage: run [--cpus LIST] [--nice N] [--sched POLICY] "
+               "[--ioprio CLASS[:LEVEL]] [--] cmd ...\n");
+        ast_pipeline_free(pipe);
+        return;
+    }
+    remove_args(argv, skip);
+
+    struct job *job = add_job(pipe);
+    if ((job->sched = malloc(sizeof *job->sched)) == NULL)
+        utils_fatal_error("cannot allocate job: ");
+    *job->sched = sched;
+    launch_job(job);
+}
+/* The limits ulimit knows, with the units their values are given in */
+static const struct ulimit_option {
+    char option;
+    int resource;
+    rlim_t unit;
+    const char *description;
+} ulimit_options[] = {
+    { 'c', RLIMIT_CORE, 1024, "core file size (kbytes)" },
+    { 'd', RLIMIT_DATA, 1024, "data seg size (kbytes)" },
+    { 'f', RLIMIT_FSIZE, 1024, "file size (kbytes)" },
+    { 'l', RLIMIT_MEMLOCK, 1024, "max locked memory (kbytes)" },
+    { 'n', RLIMIT_NOFILE, 1, "open files" },
+    { 's', RLIMIT_STACK, 1024, "stack size (kbytes)" },
+    { 't', RLIMIT_CPU, 1, "cpu time (seconds)" },
+    { 'u', RLIMIT_NPROC, 1, "max user processes" },
+    { 'v', RLIMIT_AS, 1024, "virtual memory (kbytes)" },
+};
+#define NUM_ULIMIT_OPTIONS (sizeof ulimit_options / sizeof ulimit_options[0])
+/* Find the ulimit option for an argument such as -n, or return NULL */
+static const struct ulimit_option *
+find_ulimit_option(const char *arg)
+{
+    if (arg[0] != '-' || arg[1] == '\0' || arg[2] != '\0')
+        return NULL;
+    for (int i = 0; i < NUM_ULIMIT_OPTIONS; i++)
+        if (ulimit_options[i].option == arg[1])
+            return &ulimit_options[i];
+    return NULL;
+}
+/* Parse a limit given in units of unit, or unlimited */
+static bool
+parse_rlimit(const char *arg, rlim_t unit, rlim_t *value)
+{
+    if (strcmp(arg, "unlimited") == 0) {
+        *value = RLIM_INFINITY;
+        return true;
+    }
+    char *end;
+    errno = 0;
+    unsigned long long n = strtoull(arg, &end, 10);
+    if (end == arg || *end != '\0' || arg[0] == '-' || errno != 0
+            || n >= RLIM_INFINITY / unit)
+        return false;
+    *value = n * unit;
+    return true;
+}
+/* The most open files a process may be allowed, as the kernel would
+ * otherwise refuse the limit only when commands are spawned */
+static rlim_t
+max_nofile(void)
+{
+    unsigned long long nr_open;
+    FILE *f = fopen("/proc/sys/fs/nr_open", "r");
+    if (f == NULL)
+        return RLIM_INFINITY;
+    if (fscanf(f, "%llu", &nr_open) != 1)
+        nr_open = RLIM_INFINITY;
+    fclose(f);
+    return nr_open;
+}
+/* The limit spawned processes get: the one set in rlimits, or the shell's */
+static void
+get_job_rlimit(const struct job_rlimits *rlimits, int resource, struct rlimit *limit)
+{
+    if (rlimits->mask & (1U << resource))
+        *limit = rlimits->limits[resource];
+    else
+        getrlimit(resource, limit);
+}
+static void
+print_rlimit(const struct job_rlimits *rlimits, const struct ulimit_option *o,
+             bool hard, bool all)
+{
+    struct rlimit limit;
+    get_job_rlimit(rlimits, o->resource, &limit);
+    rlim_t value = hard ? limit.rlim_max : limit.rlim_cur;
+    if (all)
+        printf("%-28s(-%c) ", o->description, o->option);
+    if (value == RLIM_INFINITY)
+        printf("unlimited\n");
+    else
+        printf("%llu\n", (unsigned long long) (value / o->unit));
+}
+/*
+ * Function that implements the ulimit command:
+ *   ulimit [-S] [-H] [-a] [-c|-d|-f|-l|-n|-s|-t|-u|-v [LIMIT]]... [-- cmd ...]
+ * sets the resource limits of the commands the shell runs, or, with
+ * -- cmd ..., runs the pipeline cmd ..., in the foreground or, with &,
+ * in the background, with these limits in addition to those set
+ * before.  LIMIT is in the units -a shows, or unlimited; -S and -H
+ * set only the soft or hard limit, otherwise both are set.  Options
+ * without a LIMIT, and -a for all, print the soft (with -H, hard)
+ * limit.  The limits are applied when commands are spawned; the
+ * shell's own limits do not change.
+ * Takes ownership of pipe.
+ */
+static void cush_ulimit(struct ast_pipeline *pipe) {
+    struct ast_command *cmd = list_entry(list_begin(&pipe->commands), struct ast_command, elem);
+    char **argv = cmd->argv;
+    struct job_rlimits rlimits = shell_rlimits;
+    const struct ulimit_option *print[NUM_ULIMIT_OPTIONS];
+    int nprint = 0;
+    bool soft = false, hard = false, all = false, set = false, ok = true;
+    const char *error = NULL;
+    int skip = 1;
+    for (; ok && error == NULL && argv[skip] != NULL && strcmp(argv[skip], "--") != 0; skip++) {
+        const struct ulimit_option *o = find_ulimit_option(argv[skip]);
+        rlim_t value;
+        if (strcmp(argv[skip], "-S") == 0) {
+            soft = true;
+        } else if (strcmp(argv[skip], "-H") == 0) {
+            hard = true;
+        } else if (strcmp(argv[skip], "-a") == 0) {
+            all = true;
+        } else if (o == NULL) {
+            ok = false;
+        } else if (argv[skip + 1] == NULL || argv[skip + 1][0] == '-') {
+            if (nprint < NUM_ULIMIT_OPTIONS)
+                print[nprint++] = o;
+        } else if (!parse_rlimit(argv[++skip], o->unit, &value)) {
+            ok = false;
+        } else {
+            struct rlimit limit, shell_limit;
+            get_job_rlimit(&rlimits, o->resource, &limit);
+            getrlimit(o->resource, &shell_limit);
+            if (soft || !hard)
+                limit.rlim_cur = value;
+            if (hard || !soft)
+                limit.rlim_max = value;
+            if (limit.rlim_cur > limit.rlim_max)
+                error = "soft limit exceeds hard limit";
+            else if (limit.rlim_max > shell_limit.rlim_max && geteuid() != 0)
+                error = "cannot raise hard limit";
+            else if (o->resource == RLIMIT_NOFILE && limit.rlim_max > max_nofile())
+                error = "limit exceeds fs.nr_open";
+            rlimits.limits[o->resource] = limit;
+            rlimits.mask |= 1U << o->resource;
+            set = true;
         }
-        else if (job == NULL) {
+    }
+    bool command = ok && error == NULL && argv[skip] != NULL;
+    if (command && (argv[skip + 1] == NULL || nprint > 0 || all))
+        ok = false;
+    if (!ok) {
+        printf("usage: ulimit [-S] [-H] [-a] [-c|-d|-f|-l|-n|-s|-t|-u|-v [LIMIT]]... "
+               "[-- cmd ...]\n");
+        ast_pipeline_free(pipe);
+        return;
+    }
+    if (error != NULL) {
+        printf("ulimit: %s: %s\n", argv[skip - 2], error);
+        ast_pipeline_free(pipe);
+        return;
+    }
+    if (!command) {
+        // Like other shells, ulimit alone prints the file size limit
+        if (!set && !all && nprint == 0)
+            print[nprint++] = find_ulimit_option("-f");
+        for (int i = 0; all && i < NUM_ULIMIT_OPTIONS; i++)
+            print_rlimit(&rlimits, &ulimit_options[i], hard && !soft, true);
+        for (int i = 0; i < nprint; i++)
+            print_rlimit(&rlimits, print[i], hard && !soft, false);
+        shell_rlimits = rlimits;
+        ast_pipeline_free(pipe);
+        return;
+    }
+    remove_args(argv, skip + 1);
+
+    struct job *job = add_job(pipe);
+    if ((job->rlimits = malloc(sizeof *job->rlimits)) == NULL)
+        utils_fatal_error("cannot allocate job: ");
+    *job->rlimits = rlimits;
+    launch_job(job);
+}
+/*
+* This function interprets the command line entered and calls the cush  * functions corresponding to it
+ */
+static void interpret(struct ast_command_line *inpCmdLine) {
+    assert(signal_is_blocked(SIGCHLD)); // prevents races with child status changes
+    // Pick up PATH and PATH directory changes once per command line
+    path_cache_revalidate();
+    struct list *listPipe = &inpCmdLine->pipes;
+    for (struct list_elem *e = list_begin(listPipe); e != list_end(listPipe);) {
+        struct ast_pipeline *pipe = list_entry(e, struct ast_pipeline, elem);
+        e = list_remove(e); // Remove to stop double processing
+        struct ast_command *cmd = list_entry(list_begin(&pipe->commands), struct ast_command, elem);
+        if (strcmp(cmd->argv[0], "batch") == 0) {
+            cush_batch(pipe);
+        } else if (strcmp(cmd->argv[0], "cgroup") == 0) {
+            cush_cgroup(pipe);
+        } else if (strcmp(cmd->argv[0], "timeout") == 0) {
+            cush_timeout(pipe);
+        } else if (strcmp(cmd->argv[0], "run") == 0) {
+            cush_run(pipe);
+        } else if (strcmp(cmd->argv[0], "ulimit") == 0) {
+            cush_ulimit(pipe);
+        } else if (list_size(&pipe->commands) == 1
+                   // Builtins whose output is redirected run as a job
+                   && (pipe->iored_output == NULL || !is_output_builtin(cmd))
+                   && run_builtin(cmd)) {
             ast_pipeline_free(pipe);
+        } else {
+            run_job(pipe);
         }
         removeFinishedJobs();
+        dispatch_batch_jobs();
         termstate_give_terminal_back_to_shell();
+        if (shell_exiting)  // the rest of the line is freed with it
+            break;
     }
-    signal_unblock(SIGCHLD);
+}
+/* Install the readline line handler, showing a fresh prompt */
+static void handle_line(char *cmdline);
+static void
+prompt_for_line(void)
+{
+    /* If you fail this assertion, you were about to read a command line
+     * without having terminal ownership.
+     * This would lead to the suspension of your shell with SIGTTOU.
+     * Make sure that you call termstate_give_terminal_back_to_shell()
+     */
+    assert(termstate_get_current_terminal_owner() == getpgrp());
+    /* Do not output a prompt unless shell's stdin is a terminal */
+    char *prompt = isatty(0) ? build_prompt() : NULL;
+    rl_callback_handler_install(prompt, handle_line);
+    free(prompt);
+}
+/*
+ * Called by readline with each complete command line
+ */
+static void
+handle_line(char *cmdline)
+{
+    if (cmdline == NULL) { /* User typed EOF */
+        rl_callback_handler_remove();
+        shell_exiting = true;
+        return;
+    }
+    prompt_visible = false;
+    struct ast_command_line *cline = ast_parse_command_line(cmdline);
+    add_history(cmdline);
+    free(cmdline);
+    if (cline != NULL && list_empty(&cline->pipes)) { /* User hit enter */
+        ast_command_line_free(cline);
+    } else if (cline != NULL) { /* NULL means error in command line */
+        // ast_command_line_print(cline);
+        interpret(cline);
+        /* Free the command line.
+         * This will free the ast_pipeline objects still contained
+         * in the ast_command_line. Once you implement a job list
+         * that may take ownership of ast_pipeline objects that are
+         * associated with jobs you will need to reconsider how you
+         * manage the lifetime of the associated ast_pipelines.
+         * Otherwise, freeing here will cause use-after-free errors.
+         */
+        ast_command_line_free(cline);
+    }
+    if (shell_exiting) { /* User typed exit */
+        rl_callback_handler_remove();
+        fflush(stdout);
+        return;
+    }
+    prompt_for_line();
+    prompt_visible = true;
 }
 /*
  * Main function that runs the cush shell
@@ -591,52 +2181,108 @@ int
 main(int ac, char *av[]) {
     int opt;
     /* Process command-line arguments. See getopt(3) */
-    while ((opt = getopt(ac, av, "h")) > 0) {
+    while ((opt = getopt(ac, av, "hprcets")) > 0) {
         switch (opt) {
             case 'h':
                 usage(av[0]);
                 break;
+            case 'p':
+                use_pidfds = true;
+                break;
+            case 'r':
+                report_usage = true;
+                break;
+            case 'c':
+                use_cgroups = true;
+                break;
+            case 'e':
+                export_jobs = true;
+                break;
+            case 't':
+                spawn_workers = sysconf(_SC_NPROCESSORS_ONLN);
+                if (spawn_workers < 2)
+                    spawn_workers = 2;
+                break;
+            case 's':
+                use_spawn_helper = true;
+                break;
         }
     }
+    /* Fork the helper before the shell opens anything it would inherit */
+    if (use_spawn_helper)
+        use_spawn_helper = spawn_helper_start();
+    extern char **environ;
+    env_table_init(environ);
+    list_init(&pending_spawns);
     list_init(&job_list);
-    signal_set_handler(SIGCHLD, sigchld_handler);
+    list_init(&finished_jobs);
+    completion_ring_init(&completions);
+    list_init(&batch_queue);
+    batch_limit = sysconf(_SC_NPROCESSORS_ONLN);
+    if (batch_limit < 1)
+        batch_limit = 1;
+    jid_bitmap_init(&jids_in_use);
+    jid_bitmap_set(&jids_in_use, 0);    /* jids start at 1 */
+    pid_table_init(&pid2job);
+    timer_heap_init(&deadlines);
+    if (use_pidfds)
+        pid_table_init(&orphan_pidfds);
+    init_child_events();
+    if (use_cgroups)
+        use_cgroups = cgroup_init();
+    if (export_jobs)
+        export_jobs = job_export_init();
     termstate_init();
     using_history(); //initialize history
+
+    /* The main loop waits for input and for child status changes
+     * at the same time, so background jobs are reported as soon
+     * as they change state. */
+    enum { INPUT_EVENT, CHILD_EVENT };
+    int main_events_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event input_ev = { .events = EPOLLIN, .data.u32 = INPUT_EVENT };
+    struct epoll_event child_ev = { .events = EPOLLIN, .data.u32 = CHILD_EVENT };
+    if (main_events_fd == -1
+        || epoll_ctl(main_events_fd, EPOLL_CTL_ADD, STDIN_FILENO, &input_ev) == -1
+        || epoll_ctl(main_events_fd, EPOLL_CTL_ADD, child_events_fd, &child_ev) == -1)
+        utils_fatal_error("cannot set up main event loop: ");
+
+    /* Keep readline's signal handlers while a line is being edited,
+     * not only while it is reading a character. */
+    rl_persistent_signal_handlers = 1;
+    prompt_for_line();
+    prompt_visible = true;
+    /* Readline's handlers are installed now, and it installs the same
+     * ones for every line; record them, and any a library installed,
+     * so children reset them.  signal_set_handler() records its own. */
+    signal_note_installed_handlers();
+
     /* Read/eval loop. */
-    for (;;) {
-        /* If you fail this assertion, you were about to call readline()
-         * without having terminal ownership.
-         * This would lead to the suspension of your shell with SIGTTOU.
-         * Make sure that you call termstate_give_terminal_back_to_shell()
-         */
-        assert(termstate_get_current_terminal_owner() == getpgrp());
-        /* Do not output a prompt unless shell's stdin is a terminal */
-        char *prompt = isatty(0) ? build_prompt() : NULL;
-        char *cmdline = readline(prompt);
-        free(prompt);
-        if (cmdline == NULL) /* User typed EOF */
-            break;
-        struct ast_command_line *cline = ast_parse_command_line(cmdline);
-        add_history(cmdline);
-        free(cmdline);
-        if (cline == NULL) /* Error in command line */
-            continue;
-        if (list_empty(&cline->pipes)) { /* User hit enter */
-            ast_command_line_free(cline);
+    while (!shell_exiting) {
+        struct epoll_event events[2];
+        int n = epoll_wait(main_events_fd, events, 2, next_timeout());
+        if (n == -1) {
+            if (errno != EINTR)
+                utils_fatal_error("epoll_wait failed: ");
+            rl_check_signals();
             continue;
         }
-        // ast_command_line_print(cline);
-        interpret(cline);
-        /* Free the command line.
-         * This will free the ast_pipeline objects still contained
-         * in the ast_command_line. Once you implement a job list
-         * that may take ownership of ast_pipeline objects that are
-         * associated with jobs you will need to reconsider how you
-         * manage the lifetime of the associated ast_pipelines.
-         * Otherwise, freeing here will cause use-after-free errors.
-         */
-        ast_command_line_free(cline);
+        if (n == 0)     /* a job deadline passed; handle it with child events */
+            events[n++].data.u32 = CHILD_EVENT;
+        for (int i = 0; i < n && !shell_exiting; i++) {
+            if (events[i].data.u32 == CHILD_EVENT) {
+                process_child_events(0);
+                /* Nothing refers to finished jobs between commands */
+                removeFinishedJobs();
+                if (prompt_erased) {
+                    fflush(stdout);
+                    rl_forced_update_display();
+                    prompt_erased = false;
+                }
+            } else {
+                rl_callback_read_char();
+            }
+        }
     }
-    return 0;
+    return last_status;
 }
-
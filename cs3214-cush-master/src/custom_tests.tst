@@ -1,2 +1,19 @@
 = Tests for Custom Features
 1 gback_glob_test.py
+1 pidfd_test.py
+1 rusage_test.py
+1 wait_test.py
+1 batch_test.py
+1 cgroup_test.py
+1 timeout_test.py
+1 bgstorm_test.py
+1 export_test.py
+1 hash_test.py
+1 closefrom_test.py
+1 parallel_spawn_test.py
+1 spawn_helper_test.py
+1 env_test.py
+1 run_test.py
+1 ulimit_test.py
+1 pipe_builtin_test.py
+1 noshebang_test.py
@@ -0,0 +1,387 @@
+/*
+ * The exported environment.
+ *
+ * Variables live in a chained hash table, and in vars, which is in
+ * the same order as their strings in slots.  slots keeps free slots
+ * in front of the first string and a NULL after the last one.
+ *
+ * An overlay moves the variables it overrides to the front of vars,
+ * and writes its strings over theirs and into the free slots before
+ * them; the overlaid environment starts at its first string.  Undoing
+ * it puts the overridden strings back.  The order of the variables
+ * changes, but nothing else needs to be copied.
+ */
+#define _GNU_SOURCE 1
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "env_table.h"
+#include "utils.h"
+
+#define MIN_BUCKETS 64
+#define MIN_VARS 64
+
+struct env_var {
+    char *str;               /* NAME=value */
+    size_t namelen;
+    size_t slot;             /* index in vars */
+    bool hidden;             /* overridden by the overlay */
+    struct env_var *next;    /* next variable in the same bucket */
+};
+
+static struct env_var **buckets;
+static size_t num_buckets;
+
+static struct env_var **vars;
+static size_t num_vars, max_vars;
+static char **slots;         /* headroom free slots, max_vars + 1 more */
+static size_t headroom;
+static unsigned long generation;
+
+/* The overlay's hidden variables are vars[0 .. num_hidden) */
+static size_t num_hidden;
+static char **overlay;       /* the overlay's strings */
+static size_t max_overlay;
+
+/* FNV-1a */
+static size_t
+hash_name(const char *name, size_t len)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char) name[i]) * 1099511628211ULL;
+    return h;
+}
+
+/* Return the length of the name in a NAME=value word, or 0 if word
+ * is not one */
+static size_t
+assignment_name_length(const char *word)
+{
+    if (!(*word == '_' || (*word >= 'A' && *word <= 'Z') || (*word >= 'a' && *word <= 'z')))
+        return 0;
+    size_t len = 1;
+    while (word[len] == '_' || (word[len] >= 'A' && word[len] <= 'Z')
+           || (word[len] >= 'a' && word[len] <= 'z') || (word[len] >= '0' && word[len] <= '9'))
+        len++;
+    return word[len] == '=' ? len : 0;
+}
+
+/* Return the link to the variable called name, or to the NULL at the
+ * end of its bucket */
+static struct env_var **
+find_var(const char *name, size_t len)
+{
+    struct env_var **v = &buckets[hash_name(name, len) & (num_buckets - 1)];
+    for (; *v != NULL; v = &(*v)->next)
+        if ((*v)->namelen == len && strncmp((*v)->str, name, len) == 0)
+            break;
+    return v;
+}
+
+/* Double the number of buckets once the table is 3/4 full */
+static void
+grow_buckets(void)
+{
+    size_t newsize = num_buckets ? 2 * num_buckets : MIN_BUCKETS;
+    struct env_var **newbuckets = calloc(newsize, sizeof *newbuckets);
+    if (newbuckets == NULL)
+        utils_fatal_error("cannot grow environment to %zu buckets: ", newsize);
+    for (size_t i = 0; i < num_buckets; i++) {
+        while (buckets[i] != NULL) {
+            struct env_var *v = buckets[i];
+            buckets[i] = v->next;
+            size_t b = hash_name(v->str, v->namelen) & (newsize - 1);
+            v->next = newbuckets[b];
+            newbuckets[b] = v;
+        }
+    }
+    free(buckets);
+    buckets = newbuckets;
+    num_buckets = newsize;
+}
+
+/* Make room for nvars variables and nfree free slots before them */
+static void
+reserve(size_t nvars, size_t nfree)
+{
+    if (nvars <= max_vars && nfree <= headroom)
+        return;
+    size_t newmax = max_vars ? max_vars : MIN_VARS;
+    while (newmax < nvars)
+        newmax *= 2;
+    size_t newheadroom = headroom;
+    while (newheadroom < nfree)
+        newheadroom = newheadroom ? 2 * newheadroom : 8;
+    struct env_var **newvars = realloc(vars, newmax * sizeof *newvars);
+    char **newslots = malloc((newheadroom + newmax + 1) * sizeof *newslots);
+    if (newvars == NULL || newslots == NULL)
+        utils_fatal_error("cannot grow environment to %zu variables: ", newmax);
+    if (slots != NULL)
+        memcpy(newslots + newheadroom, slots + headroom, (num_vars + 1) * sizeof *slots);
+    else
+        newslots[newheadroom] = NULL;
+    free(slots);
+    vars = newvars;
+    slots = newslots;
+    max_vars = newmax;
+    headroom = newheadroom;
+}
+
+static void
+place(struct env_var *v, size_t slot)
+{
+    v->slot = slot;
+    vars[slot] = v;
+    slots[headroom + slot] = v->str;
+}
+
+static void
+add_var(char *str, size_t namelen, struct env_var **link)
+{
+    struct env_var *v = malloc(sizeof *v);
+    if (v == NULL)
+        utils_fatal_error("cannot add environment variable: ");
+    *v = (struct env_var) { .str = str, .namelen = namelen };
+    *link = v;
+    reserve(num_vars + 1, headroom);
+    place(v, num_vars++);
+    slots[headroom + num_vars] = NULL;
+}
+
+/* Remove the variable *link, moving the last one into its slot */
+static void
+remove_var(struct env_var **link)
+{
+    struct env_var *v = *link;
+    *link = v->next;
+    struct env_var *last = vars[--num_vars];
+    if (last != v)
+        place(last, v->slot);
+    slots[headroom + num_vars] = NULL;
+    free(v->str);
+    free(v);
+}
+
+void
+env_table_init(char *const envp[])
+{
+    assert(num_hidden == 0);
+    if (num_buckets == 0) {
+        grow_buckets();
+        reserve(MIN_VARS, 0);
+    }
+    for (size_t i = 0; i < num_buckets; i++)
+        while (buckets[i] != NULL)
+            remove_var(&buckets[i]);
+    generation++;
+    for (char *const *e = envp; *e != NULL; e++) {
+        char *eq = strchr(*e, '=');
+        if (eq == NULL)
+            continue;
+        if (num_vars >= num_buckets * 3 / 4)
+            grow_buckets();
+        struct env_var **link = find_var(*e, eq - *e);
+        char *str = strdup(*e);
+        if (str == NULL)
+            utils_fatal_error("cannot copy environment: ");
+        if (*link != NULL) {    /* the first one counts, as in getenv */
+            free(str);
+            continue;
+        }
+        add_var(str, eq - *e, link);
+    }
+}
+
+int
+env_table_count_assignments(char *const argv[])
+{
+    int n = 0;
+    while (argv[n] != NULL && assignment_name_length(argv[n]) > 0)
+        n++;
+    return n;
+}
+
+bool
+env_table_set(const char *word, bool create)
+{
+    assert(num_hidden == 0);
+    size_t len = assignment_name_length(word);
+    if (len == 0)
+        return false;
+    if (num_vars >= num_buckets * 3 / 4)
+        grow_buckets();
+    struct env_var **link = find_var(word, len);
+    if (*link == NULL && !create)
+        return true;
+    char *str = strdup(word);
+    char *name = strndup(word, len);
+    if (str == NULL || name == NULL)
+        utils_fatal_error("cannot set environment variable: ");
+    if (*link == NULL) {
+        add_var(str, len, link);
+    } else {
+        free((*link)->str);
+        (*link)->str = str;
+        slots[headroom + (*link)->slot] = str;
+    }
+    // The shell's own lookups, such as the PATH search, see it too
+    setenv(name, word + len + 1, 1);
+    free(name);
+    generation++;
+    return true;
+}
+
+int
+env_table_unset(const char *name)
+{
+    assert(num_hidden == 0);
+    unsetenv(name);
+    struct env_var **link = find_var(name, strlen(name));
+    if (*link == NULL)
+        return -1;
+    remove_var(link);
+    generation++;
+    return 0;
+}
+
+char **
+env_table_envp(void)
+{
+    return slots + headroom;
+}
+
+unsigned long
+env_table_generation(void)
+{
+    return generation;
+}
+
+static int
+compare_strings(const void *a, const void *b)
+{
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+void
+env_table_print(FILE *out)
+{
+    char **sorted = malloc((num_vars + 1) * sizeof *sorted);
+    if (sorted == NULL)
+        utils_fatal_error("cannot sort environment: ");
+    memcpy(sorted, slots + headroom, num_vars * sizeof *sorted);
+    qsort(sorted, num_vars, sizeof *sorted, compare_strings);
+    for (size_t i = 0; i < num_vars; i++)
+        fprintf(out, "%s\n", sorted[i]);
+    free(sorted);
+}
+
+/* Exchange the variables in slots i and j */
+static void
+swap_vars(size_t i, size_t j)
+{
+    struct env_var *v = vars[i];
+    place(vars[j], i);
+    place(v, j);
+}
+
+/* Lay the n assignments in words over the table, the last one for
+ * each name winning, and return the resulting environment */
+static char **
+begin_overlay(char *const words[], int n)
+{
+    assert(num_hidden == 0);
+    if (n > max_overlay) {
+        max_overlay = n;
+        if ((overlay = realloc(overlay, max_overlay * sizeof *overlay)) == NULL)
+            utils_fatal_error("cannot apply %d assignments: ", n);
+    }
+    size_t noverlay = 0;
+    for (int i = 0; i < n; i++) {
+        size_t len = assignment_name_length(words[i]);
+        struct env_var *v = *find_var(words[i], len);
+        if (v != NULL && !v->hidden) {
+            swap_vars(v->slot, num_hidden++);
+            v->hidden = true;
+        }
+        size_t j = 0;
+        while (j < noverlay && strncmp(overlay[j], words[i], len + 1) != 0)
+            j++;
+        overlay[j] = words[i];
+        if (j == noverlay)
+            noverlay++;
+    }
+    reserve(num_vars, noverlay - num_hidden);
+    char **envp = slots + headroom + num_hidden - noverlay;
+    memcpy(envp, overlay, noverlay * sizeof *envp);
+    return envp;
+}
+
+static void
+end_overlay(void)
+{
+    for (size_t i = 0; i < num_hidden; i++) {
+        vars[i]->hidden = false;
+        slots[headroom + i] = vars[i]->str;
+    }
+    num_hidden = 0;
+}
+
+/* The stage hook of a pipeline whose stages are spawned one at a
+ * time: lay each stage's assignments over the table while it is
+ * spawned */
+static void
+overlay_stage(struct posix_spawn_pipeline *pipeline, int i, int begin)
+{
+    const struct env_assignments *assignments = pipeline->hook_arg;
+    struct posix_spawn_stage *stage = &pipeline->stages[i];
+    if (!begin) {
+        end_overlay();
+        stage->envp = NULL;
+    } else if (assignments[i].n > 0) {
+        stage->envp = begin_overlay(assignments[i].words, assignments[i].n);
+    } else {
+        // An earlier stage's overlay may have moved the table
+        stage->envp = env_table_envp();
+    }
+}
+
+char **
+env_table_begin_spawn(struct posix_spawn_pipeline *pipeline,
+                      const struct env_assignments assignments[])
+{
+    if (assignments == NULL)
+        return env_table_envp();
+    if (pipeline->nworkers <= 1) {
+        pipeline->stage_hook = overlay_stage;
+        pipeline->hook_arg = (void *) assignments;
+        return env_table_envp();
+    }
+
+    // The stages are spawned at the same time, so each needs its own
+    for (int i = 0; i < pipeline->nstages; i++) {
+        if (assignments[i].n == 0)
+            continue;
+        char **envp = begin_overlay(assignments[i].words, assignments[i].n);
+        size_t size = (slots + headroom + num_vars + 1 - envp) * sizeof *envp;
+        char **copy = malloc(size);
+        if (copy == NULL)
+            utils_fatal_error("cannot copy environment: ");
+        memcpy(copy, envp, size);
+        end_overlay();
+        pipeline->stages[i].envp = copy;
+    }
+    return env_table_envp();
+}
+
+void
+env_table_end_spawn(struct posix_spawn_pipeline *pipeline)
+{
+    end_overlay();
+    for (int i = 0; i < pipeline->nstages; i++) {
+        free((void *) pipeline->stages[i].envp);
+        pipeline->stages[i].envp = NULL;
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef __ENV_TABLE_H
+#define __ENV_TABLE_H
+
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * The environment exported to the commands the shell runs.
+ *
+ * Variables are kept in a hash table, and their strings in an envp
+ * array that is updated in place as they are set and unset, so it
+ * can be passed to posix_spawn as is.  A command's NAME=value
+ * assignments are laid over the array while it is spawned, which
+ * costs time in the number of assignments, not of variables.
+ */
+
+/* The NAME=value words in front of a command */
+struct env_assignments {
+    char *const *words;
+    int n;
+};
+
+/* Replace the table's contents with the variables in envp */
+void env_table_init(char *const envp[]);
+
+/* Return the number of NAME=value words at the start of argv */
+int env_table_count_assignments(char *const argv[]);
+
+/* Set a variable from a NAME=value word, unless it is not set and
+ * create is false.  Returns false if word is not an assignment. */
+bool env_table_set(const char *word, bool create);
+
+/* Unset a variable; returns -1 if it was not set */
+int env_table_unset(const char *name);
+
+/* Return the environment.  It is valid until the table changes. */
+char **env_table_envp(void);
+
+/* Return a number that changes whenever the table does */
+unsigned long env_table_generation(void);
+
+/* Print the variables, sorted, one NAME=value per line */
+void env_table_print(FILE *out);
+
+/*
+ * Give each stage of pipeline the environment with assignments[i]
+ * applied, or none if assignments is NULL, and return the environment
+ * to pass to posix_spawn_pipeline_np.  If the stages are spawned one
+ * at a time, each stage's assignments are laid over the table while it
+ * is spawned, through the pipeline's stage hook; if several workers
+ * spawn them, each command with assignments gets a copy of its own in
+ * its stage's envp.  The table must not change until
+ * env_table_end_spawn(pipeline).
+ */
+char **env_table_begin_spawn(struct posix_spawn_pipeline *pipeline,
+                             const struct env_assignments assignments[]);
+
+/* Undo env_table_begin_spawn once pipeline was spawned */
+void env_table_end_spawn(struct posix_spawn_pipeline *pipeline);
+
+#endif /* __ENV_TABLE_H */
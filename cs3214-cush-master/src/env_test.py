@@ -0,0 +1,89 @@
+#!/usr/bin/python
+#
+# Tests the environment: export and unset change what commands see,
+# assignments in front of a command apply to that command only, in
+# pipelines too, and the environment of later commands is unchanged.
+# A PATH assignment changes where its command is searched for.
+#
+import atexit, os, shutil, stat, tempfile
+from testutils import *
+
+# Many variables, so assignments must not disturb the others
+for i in range(2000):
+    os.environ["CUSH_TEST_VAR%d" % i] = str(i)
+os.environ.pop("CUSH_FOO", None)
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("export CUSH_FOO=bar")
+expect_prompt("Shell did not print expected prompt (2)")
+sendline("printenv CUSH_FOO")
+expect_exact("bar\r\n", "exported variable not passed on")
+expect_prompt("Shell did not print expected prompt (3)")
+
+# an assignment overrides a variable for one command only
+sendline("CUSH_FOO=baz CUSH_TEST_VAR7=seven printenv CUSH_FOO CUSH_TEST_VAR7 CUSH_TEST_VAR8")
+expect_exact("baz\r\nseven\r\n8\r\n", "assignments not applied")
+expect_prompt("Shell did not print expected prompt (4)")
+sendline("printenv CUSH_FOO CUSH_TEST_VAR7")
+expect_exact("bar\r\n7\r\n", "assignments outlived their command")
+expect_prompt("Shell did not print expected prompt (5)")
+
+# each command in a pipeline gets its own assignments
+sendline("CUSH_A=1 env | CUSH_B=2 grep ^CUSH_[AB]=")
+expect_exact("CUSH_A=1\r\n", "assignment not passed to first command")
+expect_prompt("Shell did not print expected prompt (6)")
+sendline("CUSH_A=1 true | CUSH_B=2 env | grep ^CUSH_[AB]=")
+expect_exact("CUSH_B=2\r\n", "assignment not passed to second command")
+expect_prompt("Shell did not print expected prompt (7)")
+sendline(" ".join("CUSH_NEW%d=%d" % (i, i) for i in range(40)) + " true | env | grep -c ^CUSH_")
+expect_exact("2001\r\n", "a stage without assignments saw another stage's")
+expect_prompt("Shell did not print expected prompt (8)")
+
+# the last assignment to a name wins, and the count is unchanged
+sendline("CUSH_NEW=1 CUSH_NEW=2 env | grep -c ^CUSH_")
+expect_exact("2002\r\n", "duplicate or missing variables")
+expect_prompt("Shell did not print expected prompt (9)")
+
+# an assignment without a command changes exported variables only
+sendline("CUSH_FOO=qux CUSH_BAR=1")
+expect_prompt("Shell did not print expected prompt (10)")
+sendline("env | grep ^CUSH_[FB]")
+expect_exact("CUSH_FOO=qux\r\n", "exported variable not changed")
+expect_prompt("Shell did not print expected prompt (11)")
+assert "CUSH_BAR" not in console.before, 'unexported variable was exported'
+
+sendline("unset CUSH_FOO CUSH_TEST_VAR0")
+expect_prompt("Shell did not print expected prompt (12)")
+sendline("env | grep -c ^CUSH_")
+expect_exact("1999\r\n", "unset did not remove variables")
+expect_prompt("Shell did not print expected prompt (13)")
+
+# a PATH assignment applies to the search for its command only
+tmpdir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, tmpdir)
+onlyhere = os.path.join(tmpdir, "onlyhere")
+with open(onlyhere, "w") as f:
+    f.write("#!/bin/sh\necho onlyhere-ran\n")
+os.chmod(onlyhere, stat.S_IRWXU)
+sendline("PATH=%s:/usr/bin:/bin onlyhere | cat" % tmpdir)
+expect_exact("onlyhere-ran\r\n", "command not searched for on the assigned PATH")
+expect_prompt("Shell did not print expected prompt (14)")
+sendline("onlyhere")
+expect_exact("no such file or directory", "assigned PATH outlived its command")
+expect_prompt("Shell did not print expected prompt (15)")
+sendline("PATH=%s cat /dev/null" % tmpdir)
+expect_exact("no such file or directory", "command found outside the assigned PATH")
+expect_prompt("Shell did not print expected prompt (16)")
+
+sendline("export 1x=2")
+expect_exact("export: 1x=2: not a valid identifier", "invalid name accepted")
+expect_prompt("Shell did not print expected prompt (17)")
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,51 @@
+#!/usr/bin/python
+#
+# Tests the exported job table (cush -e): jobmon shows each job with
+# its status, processes and command line, and the table follows
+# the shell's job changes and disappears when the shell exits.
+#
+import atexit, proc_check, subprocess, time
+from testutils import *
+
+console = setup_tests([" -e"])
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+def jobmon():
+    return subprocess.run(["./jobmon", str(console.pid)],
+                          capture_output=True, text=True)
+
+sendline("sleep 10 | cat &")
+(jobid1, pid1) = parse_bg_status()
+expect_prompt("Shell did not print expected prompt (2)")
+sendline("sleep 10 &")
+(jobid2, pid2) = parse_bg_status()
+expect_prompt("Shell did not print expected prompt (3)")
+run_builtin('stop', jobid2)
+expect_prompt("Shell did not print expected prompt (4)")
+time.sleep(0.2)
+
+out = jobmon().stdout
+assert re.search(r"\[" + jobid1 + r"\]\s+Running\s+.*pgid " + pid1 + r"\s+pids " + pid1 + r",\d+\s+sleep 10 \| cat", out), \
+    'running job not exported: ' + out
+assert re.search(r"\[" + jobid2 + r"\]\s+Stopped\s+.*pgid " + pid2 + r"\s+pids " + pid2 + r"\s+sleep 10", out), \
+    'stopped job not exported: ' + out
+
+# deleted jobs disappear
+run_builtin('kill', jobid2)
+expect_prompt("Shell did not print expected prompt (5)")
+out = jobmon().stdout
+assert "[" + jobid2 + "]" not in out, 'killed job still exported: ' + out
+assert "[" + jobid1 + "]" in out, 'running job no longer exported: ' + out
+
+run_builtin('kill', jobid1)
+expect_prompt("Shell did not print expected prompt (6)")
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+console.expect(pexpect.EOF)
+time.sleep(0.2)
+assert jobmon().returncode != 0, 'job table left behind after exit'
+
+test_success()
@@ -0,0 +1,74 @@
+#!/usr/bin/python
+#
+# Tests the command path cache and the hash builtin: commands are
+# remembered with their use counts, commands that were not found are
+# found once they appear in a PATH directory, and a command added to
+# an earlier PATH directory takes precedence.
+#
+import atexit, os, proc_check, shutil, stat, tempfile, time
+from testutils import *
+
+tmpdir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, tmpdir)
+first = os.path.join(tmpdir, "first")
+second = os.path.join(tmpdir, "second")
+os.mkdir(first)
+os.mkdir(second)
+os.environ["PATH"] = first + ":" + second + ":" + os.environ["PATH"]
+
+def make_tool(directory, output):
+    path = os.path.join(directory, "hashtool")
+    with open(path, "w") as f:
+        f.write("#!/bin/sh\necho " + output + "\n")
+    os.chmod(path, stat.S_IRWXU)
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("hash")
+expect_exact("hash: hash table empty", "hash table not empty at start")
+expect_prompt("Shell did not print expected prompt (2)")
+
+sendline("true")
+expect_prompt("Shell did not print expected prompt (3)")
+sendline("true")
+expect_prompt("Shell did not print expected prompt (4)")
+sendline("hashtool")
+expect_prompt("Shell did not print expected prompt (5)")
+sendline("hash")
+expect_prompt("Shell did not print expected prompt (6)")
+assert re.search(r"\s2\s+\S*/true\r\n", console.before), 'use count of true not listed'
+assert re.search(r"\s1\s+hashtool \(not found\)\r\n", console.before), 'missing command not listed'
+
+# a command that was not found is found once it exists
+make_tool(second, "second")
+sendline("hashtool")
+expect_exact("second", "new command was not found")
+expect_prompt("Shell did not print expected prompt (7)")
+
+# a command in an earlier PATH directory shadows the cached one
+make_tool(first, "first")
+sendline("hashtool")
+expect_exact("first", "cached command was not replaced")
+expect_prompt("Shell did not print expected prompt (8)")
+
+# a cached command that went away is searched for again
+os.unlink(os.path.join(first, "hashtool"))
+sendline("hashtool")
+expect_exact("second", "removed command was still used")
+expect_prompt("Shell did not print expected prompt (9)")
+
+sendline("hash -d hashtool")
+expect_prompt("Shell did not print expected prompt (10)")
+sendline("hash -r")
+expect_prompt("Shell did not print expected prompt (11)")
+sendline("hash")
+expect_exact("hash: hash table empty", "hash -r did not empty the table")
+expect_prompt("Shell did not print expected prompt (12)")
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,113 @@
+/*
+ * Hierarchical bitmap used to allocate job ids and to iterate
+ * over live jobs in job id order.
+ */
+#include <assert.h>
+#include <string.h>
+
+#include "jid_bitmap.h"
+
+#define BIT(n) ((uint64_t) 1 << (n))
+
+/* All bits at positions >= n */
+static uint64_t
+bits_from(int n)
+{
+    return n >= 64 ? 0 : ~(uint64_t) 0 << n;
+}
+
+void
+jid_bitmap_init(struct jid_bitmap *map)
+{
+    memset(map->used, 0, sizeof map->used);
+    memset(map->nonempty, 0, sizeof map->nonempty);
+    memset(map->nonfull, 0xff, sizeof map->nonfull);
+    map->nonempty_top = 0;
+    map->nonfull_top = BIT(JID_BITMAP_SUMMARY_WORDS) - 1;
+}
+
+/* Bring the summary bits for leaf word w up to date */
+static void
+update_summaries(struct jid_bitmap *map, int w)
+{
+    int s = w / 64;
+    uint64_t bit = BIT(w % 64);
+
+    if (map->used[w] == ~(uint64_t) 0)
+        map->nonfull[s] &= ~bit;
+    else
+        map->nonfull[s] |= bit;
+
+    if (map->used[w] == 0)
+        map->nonempty[s] &= ~bit;
+    else
+        map->nonempty[s] |= bit;
+
+    if (map->nonfull[s])
+        map->nonfull_top |= BIT(s);
+    else
+        map->nonfull_top &= ~BIT(s);
+
+    if (map->nonempty[s])
+        map->nonempty_top |= BIT(s);
+    else
+        map->nonempty_top &= ~BIT(s);
+}
+
+void
+jid_bitmap_set(struct jid_bitmap *map, int id)
+{
+    assert(id >= 0 && id < JID_BITMAP_SIZE);
+    map->used[id / 64] |= BIT(id % 64);
+    update_summaries(map, id / 64);
+}
+
+void
+jid_bitmap_clear(struct jid_bitmap *map, int id)
+{
+    assert(id >= 0 && id < JID_BITMAP_SIZE);
+    map->used[id / 64] &= ~BIT(id % 64);
+    update_summaries(map, id / 64);
+}
+
+int
+jid_bitmap_alloc(struct jid_bitmap *map)
+{
+    if (map->nonfull_top == 0)
+        return -1;
+
+    int s = __builtin_ctzll(map->nonfull_top);
+    int w = s * 64 + __builtin_ctzll(map->nonfull[s]);
+    int id = w * 64 + __builtin_ctzll(~map->used[w]);
+    jid_bitmap_set(map, id);
+    return id;
+}
+
+int
+jid_bitmap_next(struct jid_bitmap *map, int from)
+{
+    if (from < 0)
+        from = 0;
+    if (from >= JID_BITMAP_SIZE)
+        return -1;
+
+    /* Rest of the leaf word containing 'from' */
+    int w = from / 64;
+    uint64_t bits = map->used[w] & bits_from(from % 64);
+    if (bits)
+        return w * 64 + __builtin_ctzll(bits);
+
+    /* Later leaf words under the same summary word */
+    int s = w / 64;
+    bits = map->nonempty[s] & bits_from(w % 64 + 1);
+    if (bits == 0) {
+        /* Later summary words */
+        uint64_t top = map->nonempty_top & bits_from(s + 1);
+        if (top == 0)
+            return -1;
+        s = __builtin_ctzll(top);
+        bits = map->nonempty[s];
+    }
+    w = s * 64 + __builtin_ctzll(bits);
+    return w * 64 + __builtin_ctzll(map->used[w]);
+}
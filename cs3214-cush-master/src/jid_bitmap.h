@@ -0,0 +1,40 @@
+#ifndef __JID_BITMAP_H
+#define __JID_BITMAP_H
+
+#include <stdint.h>
+
+/*
+ * A two-level bitmap over JID_BITMAP_SIZE ids.
+ *
+ * Allocation returns the lowest free id, and iteration visits only
+ * ids that are in use; both use find-first-set on the summary words,
+ * so they cost O(1) per call/visited id rather than O(JID_BITMAP_SIZE).
+ */
+#define JID_BITMAP_SIZE (1<<16)
+#define JID_BITMAP_WORDS (JID_BITMAP_SIZE / 64)
+#define JID_BITMAP_SUMMARY_WORDS (JID_BITMAP_WORDS / 64)
+
+struct jid_bitmap {
+    uint64_t used[JID_BITMAP_WORDS];              /* bit set: id is in use */
+    uint64_t nonfull[JID_BITMAP_SUMMARY_WORDS];   /* bit i: used[i] has a clear bit */
+    uint64_t nonempty[JID_BITMAP_SUMMARY_WORDS];  /* bit i: used[i] has a set bit */
+    uint64_t nonfull_top;    /* bit j: nonfull[j] != 0 */
+    uint64_t nonempty_top;   /* bit j: nonempty[j] != 0 */
+};
+
+/* Initialize with all ids free */
+void jid_bitmap_init(struct jid_bitmap *map);
+
+/* Allocate the lowest free id, or return -1 if all are in use */
+int jid_bitmap_alloc(struct jid_bitmap *map);
+
+/* Mark id as in use */
+void jid_bitmap_set(struct jid_bitmap *map, int id);
+
+/* Mark id as free */
+void jid_bitmap_clear(struct jid_bitmap *map, int id);
+
+/* Return the lowest id >= from that is in use, or -1 */
+int jid_bitmap_next(struct jid_bitmap *map, int from);
+
+#endif /* __JID_BITMAP_H */
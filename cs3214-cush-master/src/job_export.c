@@ -0,0 +1,141 @@
+/*
+ * Shared-memory mirror of the job table.
+ *
+ * The writer brackets each change with two increments of seq: the
+ * first makes it odd and is ordered before the data stores by a
+ * release fence; the second makes it even again and is a release
+ * store, so a reader that acquires the final value sees all data.
+ * Readers copy the table between two loads of seq and retry if it
+ * changed or was odd.
+ */
+#define _GNU_SOURCE 1
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "job_export.h"
+#include "utils.h"
+
+static struct job_export_table *table;
+static char shm_name[32];
+
+static void
+job_export_cleanup(void)
+{
+    shm_unlink(shm_name);
+}
+
+bool
+job_export_init(void)
+{
+    snprintf(shm_name, sizeof shm_name, "/cush.%d", getpid());
+    int fd = shm_open(shm_name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        utils_error("cannot create /dev/shm%s: ", shm_name);
+        return false;
+    }
+    if (ftruncate(fd, sizeof *table) == -1
+            || (table = mmap(NULL, sizeof *table, PROT_READ | PROT_WRITE,
+                             MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        utils_error("cannot map /dev/shm%s: ", shm_name);
+        table = NULL;
+        close(fd);
+        shm_unlink(shm_name);
+        return false;
+    }
+    close(fd);
+    atexit(job_export_cleanup);
+
+    /* The file starts out zeroed; only unused slots need marking */
+    for (int i = 0; i < JOB_EXPORT_SLOTS; i++)
+        table->jobs[i].jid = -1;
+    table->shell_pid = getpid();
+    table->version = JOB_EXPORT_VERSION;
+    atomic_init(&table->seq, 0);
+    atomic_thread_fence(memory_order_release);
+    table->magic = JOB_EXPORT_MAGIC;
+    return true;
+}
+
+static void
+write_begin(void)
+{
+    unsigned int seq = atomic_load_explicit(&table->seq, memory_order_relaxed);
+    atomic_store_explicit(&table->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void
+write_end(void)
+{
+    unsigned int seq = atomic_load_explicit(&table->seq, memory_order_relaxed);
+    atomic_store_explicit(&table->seq, seq + 1, memory_order_release);
+}
+
+void
+job_export_publish(const struct job_export_entry *entry)
+{
+    if (table == NULL || entry->jid < 0 || entry->jid >= JOB_EXPORT_SLOTS)
+        return;
+    write_begin();
+    table->jobs[entry->jid] = *entry;
+    if (entry->jid >= table->num_used_slots)
+        table->num_used_slots = entry->jid + 1;
+    write_end();
+}
+
+void
+job_export_remove(int jid)
+{
+    if (table == NULL || jid < 0 || jid >= JOB_EXPORT_SLOTS)
+        return;
+    write_begin();
+    table->jobs[jid].jid = -1;
+    while (table->num_used_slots > 0 && table->jobs[table->num_used_slots - 1].jid == -1)
+        table->num_used_slots--;
+    write_end();
+}
+
+const struct job_export_table *
+job_export_open(pid_t pid)
+{
+    char name[32];
+    snprintf(name, sizeof name, "/cush.%d", pid);
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd == -1)
+        return NULL;
+    const struct job_export_table *t = mmap(NULL, sizeof *t, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (t == MAP_FAILED)
+        return NULL;
+    if (t->magic != JOB_EXPORT_MAGIC || t->version != JOB_EXPORT_VERSION) {
+        munmap((void *) t, sizeof *t);
+        return NULL;
+    }
+    return t;
+}
+
+void
+job_export_snapshot(const struct job_export_table *t, struct job_export_table *snap)
+{
+    for (;;) {
+        unsigned int seq = atomic_load_explicit(&t->seq, memory_order_acquire);
+        if (seq & 1)
+            continue;
+        snap->magic = t->magic;
+        snap->version = t->version;
+        snap->shell_pid = t->shell_pid;
+        snap->num_used_slots = t->num_used_slots;
+        if (snap->num_used_slots > JOB_EXPORT_SLOTS)
+            snap->num_used_slots = JOB_EXPORT_SLOTS;
+        memcpy(snap->jobs, t->jobs, snap->num_used_slots * sizeof t->jobs[0]);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&t->seq, memory_order_relaxed) == seq) {
+            atomic_init(&snap->seq, seq);
+            return;
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef __JOB_EXPORT_H
+#define __JOB_EXPORT_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * A read-only mirror of a shell's job table in shared memory, at
+ * /dev/shm/cush.<pid>, so monitors can see what a shell is running
+ * without talking to it.
+ *
+ * The shell is the only writer.  It publishes every change under a
+ * sequence lock: seq is odd while an update is in progress, and a
+ * reader that sees the same even seq before and after copying the
+ * table has a consistent snapshot.  Readers never make system calls
+ * into the shell and never block it.
+ *
+ * Slot i holds job i.  Jobs whose id is JOB_EXPORT_SLOTS or larger
+ * are not exported.
+ */
+#define JOB_EXPORT_MAGIC 0x6a6f6273        /* "jobs" */
+#define JOB_EXPORT_VERSION 1
+#define JOB_EXPORT_SLOTS 1024
+#define JOB_EXPORT_MAX_PIDS 16
+#define JOB_EXPORT_STATUS_LEN 24
+#define JOB_EXPORT_CMDLINE_LEN 256
+
+struct job_export_entry {
+    int32_t jid;             /* -1 if the slot is unused */
+    int32_t pgid;            /* 0 until the job has been spawned */
+    int32_t num_pids;        /* only the first JOB_EXPORT_MAX_PIDS are listed */
+    int32_t pids[JOB_EXPORT_MAX_PIDS];
+    int64_t start_time;      /* ms since the Epoch, 0 until spawned */
+    char status[JOB_EXPORT_STATUS_LEN];     /* as shown by jobs */
+    char cmdline[JOB_EXPORT_CMDLINE_LEN];   /* truncated if too long */
+};
+
+struct job_export_table {
+    uint32_t magic;
+    uint32_t version;
+    int32_t shell_pid;
+    atomic_uint seq;         /* odd while the shell updates the table */
+    uint32_t num_used_slots; /* slots at and beyond this one are unused */
+    struct job_export_entry jobs[JOB_EXPORT_SLOTS];
+};
+
+/* Shell side */
+
+/* Create the shared table of this process.  It is removed when the
+ * process exits.  Returns false if it cannot be created. */
+bool job_export_init(void);
+
+/* Add or update the job entry->jid */
+void job_export_publish(const struct job_export_entry *entry);
+
+/* Remove job jid */
+void job_export_remove(int jid);
+
+/* Reader side */
+
+/* Map the table of shell pid read-only, or return NULL */
+const struct job_export_table *job_export_open(pid_t pid);
+
+/* Copy a consistent snapshot of table into snap.  Slots at and
+ * beyond snap->num_used_slots are left untouched. */
+void job_export_snapshot(const struct job_export_table *table, struct job_export_table *snap);
+
+#endif /* __JOB_EXPORT_H */
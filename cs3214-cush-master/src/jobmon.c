@@ -0,0 +1,107 @@
+/*
+ * jobmon - show the jobs of running shells that export their job
+ * table (cush -e), without interacting with the shells.
+ *
+ * Usage: jobmon [-i seconds] [pid...]
+ *
+ * Without pids, every exporting shell is shown.  With -i, the
+ * tables are shown again every given number of seconds.
+ */
+#define _GNU_SOURCE 1
+#include <dirent.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "job_export.h"
+
+/* One snapshot buffer is enough; tables are shown one at a time */
+static struct job_export_table snap;
+
+static long long
+now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/* Print the jobs of shell pid; returns false if it exports none */
+static bool
+show_shell(pid_t pid)
+{
+    const struct job_export_table *table = job_export_open(pid);
+    if (table == NULL)
+        return false;
+    job_export_snapshot(table, &snap);
+    munmap((void *) table, sizeof *table);
+
+    long long now = now_ms();
+    printf("cush %d\n", snap.shell_pid);
+    for (int i = 0; i < snap.num_used_slots; i++) {
+        struct job_export_entry *job = &snap.jobs[i];
+        if (job->jid == -1)
+            continue;
+        printf("[%d]\t%-18s", job->jid, job->status);
+        if (job->start_time != 0)
+            printf("%8.1fs  pgid %d  pids", (now - job->start_time) / 1000.0, job->pgid);
+        for (int p = 0; p < job->num_pids && p < JOB_EXPORT_MAX_PIDS; p++)
+            printf("%c%d", p == 0 ? ' ' : ',', job->pids[p]);
+        printf("\t%s\n", job->cmdline);
+    }
+    return true;
+}
+
+/* Show every live shell with a table in /dev/shm */
+static void
+show_all_shells(void)
+{
+    DIR *dir = opendir("/dev/shm");
+    if (dir == NULL) {
+        perror("/dev/shm");
+        exit(EXIT_FAILURE);
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        int pid;
+        if (sscanf(entry->d_name, "cush.%d", &pid) == 1 && kill(pid, 0) == 0)
+            show_shell(pid);
+    }
+    closedir(dir);
+}
+
+int
+main(int ac, char *av[])
+{
+    double interval = 0;
+    int opt;
+    while ((opt = getopt(ac, av, "i:")) > 0) {
+        switch (opt) {
+        case 'i':
+            interval = atof(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-i seconds] [pid...]\n", av[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    int status = EXIT_SUCCESS;
+    for (;;) {
+        if (optind == ac)
+            show_all_shells();
+        for (int i = optind; i < ac; i++) {
+            if (!show_shell(atoi(av[i]))) {
+                fprintf(stderr, "%s: shell %s does not export its jobs\n", av[0], av[i]);
+                status = EXIT_FAILURE;
+            }
+        }
+        if (interval <= 0)
+            return status;
+        fflush(stdout);
+        usleep(interval * 1e6);
+    }
+}
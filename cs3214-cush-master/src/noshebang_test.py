@@ -0,0 +1,36 @@
+#!/usr/bin/python
+#
+# Tests that an executable script without a #! line is run with
+# /bin/sh, whether it is named by path or found through the path
+# cache.
+#
+import atexit, os, shutil, stat, tempfile
+from testutils import *
+
+tmpdir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, tmpdir)
+script = os.path.join(tmpdir, "noshebang")
+with open(script, "w") as f:
+    f.write("echo noshebang-ran $1\n")
+os.chmod(script, stat.S_IRWXU)
+os.environ["PATH"] = tmpdir + ":" + os.environ["PATH"]
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline(script + " path")
+expect_exact("noshebang-ran path\r\n", "script named by path not run")
+expect_prompt("Shell did not print expected prompt (2)")
+
+# twice, so the second run uses the cached path
+for i in range(2):
+    sendline("noshebang cached | cat")
+    expect_exact("noshebang-ran cached\r\n", "script found on PATH not run")
+    expect_prompt("Shell did not print expected prompt (3)")
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,46 @@
+#!/usr/bin/python
+#
+# Tests spawning the commands of long pipelines from several threads
+# (cush -t): the stages are connected in order, and all of them are
+# in the process group of the first one.
+#
+import atexit, proc_check, time
+from testutils import *
+
+console = setup_tests([" -t"])
+
+def pgid_of(pid):
+    with open("/proc/%d/stat" % pid) as f:
+        return int(f.read().rsplit(")", 1)[1].split()[2])
+
+def children_of(pid):
+    children = []
+    for entry in os.listdir("/proc"):
+        if entry.isdigit():
+            try:
+                with open("/proc/%s/stat" % entry) as f:
+                    if int(f.read().rsplit(")", 1)[1].split()[1]) == pid:
+                        children.append(int(entry))
+            except IOError:
+                pass
+    return children
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("echo hello | " + "cat | " * 10 + "tr h j | rev | rev")
+expect_exact("jello\r\n", "pipeline stages were not connected in order")
+expect_prompt("Shell did not print expected prompt (2)")
+
+sendline(" | ".join(["sleep 2"] * 12) + " &")
+(jobid, pid) = parse_bg_status()
+expect_prompt("Shell did not print expected prompt (3)")
+stages = children_of(get_shell_pid())
+assert len(stages) == 12, 'not all stages were spawned'
+for stage in stages:
+    assert pgid_of(stage) == int(pid), 'a stage is not in the job\'s process group'
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
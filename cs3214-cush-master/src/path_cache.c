@@ -0,0 +1,266 @@
+/*
+ * Command lookup cache.
+ *
+ * Commands are kept in a chained hash table.  Each entry remembers
+ * the index of the PATH directory it was found in, so a change to a
+ * directory only invalidates entries found at or after it, and
+ * entries for commands that were not found.
+ */
+#define _GNU_SOURCE 1
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "path_cache.h"
+#include "utils.h"
+
+/* execvp() searches this when PATH is not set */
+#define DEFAULT_PATH "/bin:/usr/bin"
+#define MIN_BUCKETS 64
+
+struct path_entry {
+    char *name;
+    char *path;              /* NULL if name was not found */
+    int dir;                 /* index of the directory path is in */
+    unsigned long hits;
+    struct path_entry *next; /* next entry in the same bucket */
+};
+
+/* A PATH directory as it was when it was last checked */
+struct path_dir {
+    char *name;
+    bool exists;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+};
+
+static struct path_entry **buckets;
+static size_t num_buckets;
+static size_t num_entries;
+
+static char *cached_path;    /* the value of PATH dirs were split from */
+static struct path_dir *dirs;
+static int num_dirs;
+
+/* FNV-1a */
+static size_t
+hash_name(const char *name)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (; *name; name++)
+        h = (h ^ (unsigned char) *name) * 1099511628211ULL;
+    return h;
+}
+
+static struct path_entry **
+find_entry(const char *name)
+{
+    if (num_buckets == 0)
+        return NULL;
+    struct path_entry **e = &buckets[hash_name(name) & (num_buckets - 1)];
+    for (; *e != NULL; e = &(*e)->next)
+        if (strcmp((*e)->name, name) == 0)
+            return e;
+    return e;
+}
+
+static void
+free_entry(struct path_entry *e)
+{
+    free(e->name);
+    free(e->path);
+    free(e);
+}
+
+/* Double the number of buckets once the table is 3/4 full */
+static void
+grow_table(void)
+{
+    size_t newsize = num_buckets ? 2 * num_buckets : MIN_BUCKETS;
+    struct path_entry **newbuckets = calloc(newsize, sizeof *newbuckets);
+    if (newbuckets == NULL)
+        utils_fatal_error("cannot grow path cache to %zu buckets: ", newsize);
+    for (size_t i = 0; i < num_buckets; i++) {
+        while (buckets[i] != NULL) {
+            struct path_entry *e = buckets[i];
+            buckets[i] = e->next;
+            size_t b = hash_name(e->name) & (newsize - 1);
+            e->next = newbuckets[b];
+            newbuckets[b] = e;
+        }
+    }
+    free(buckets);
+    buckets = newbuckets;
+    num_buckets = newsize;
+}
+
+/* Remove entries found in directory first_dir or later, and
+ * entries for commands that were not found */
+static void
+drop_entries_from(int first_dir)
+{
+    for (size_t i = 0; i < num_buckets; i++) {
+        for (struct path_entry **e = &buckets[i]; *e != NULL; ) {
+            struct path_entry *entry = *e;
+            if (entry->path == NULL || entry->dir >= first_dir) {
+                *e = entry->next;
+                free_entry(entry);
+                num_entries--;
+            } else {
+                e = &entry->next;
+            }
+        }
+    }
+}
+
+/* Check whether a directory changed since it was last checked */
+static bool
+update_dir(struct path_dir *dir)
+{
+    struct stat st;
+    bool exists = stat(dir->name, &st) == 0;
+    if (exists == dir->exists && (!exists
+            || (st.st_dev == dir->dev && st.st_ino == dir->ino
+                && st.st_mtim.tv_sec == dir->mtime.tv_sec
+                && st.st_mtim.tv_nsec == dir->mtime.tv_nsec)))
+        return false;
+    dir->exists = exists;
+    if (exists) {
+        dir->dev = st.st_dev;
+        dir->ino = st.st_ino;
+        dir->mtime = st.st_mtim;
+    }
+    return true;
+}
+
+/* Split PATH into dirs; an empty entry means the current directory */
+static void
+set_path(const char *path)
+{
+    for (int i = 0; i < num_dirs; i++)
+        free(dirs[i].name);
+    free(dirs);
+    free(cached_path);
+
+    cached_path = strdup(path);
+    num_dirs = 1;
+    for (const char *p = path; *p; p++)
+        num_dirs += *p == ':';
+    dirs = calloc(num_dirs, sizeof *dirs);
+    if (dirs == NULL)
+        utils_fatal_error("cannot allocate PATH directories: ");
+
+    const char *start = path;
+    for (int i = 0; i < num_dirs; i++) {
+        size_t len = strcspn(start, ":");
+        dirs[i].name = len == 0 ? strdup(".") : strndup(start, len);
+        update_dir(&dirs[i]);
+        start += len + 1;
+    }
+}
+
+void
+path_cache_revalidate(void)
+{
+    const char *path = getenv("PATH");
+    if (path == NULL)
+        path = DEFAULT_PATH;
+    if (cached_path == NULL || strcmp(path, cached_path) != 0) {
+        path_cache_clear();
+        set_path(path);
+        return;
+    }
+
+    int first_changed = num_dirs;
+    for (int i = num_dirs - 1; i >= 0; i--)
+        if (update_dir(&dirs[i]))
+            first_changed = i;
+    if (first_changed < num_dirs)
+        drop_entries_from(first_changed);
+}
+
+/* Search the PATH directories for an executable file called name */
+static struct path_entry *
+search_path(const char *name)
+{
+    struct path_entry *entry = calloc(1, sizeof *entry);
+    if (entry == NULL)
+        utils_fatal_error("cannot allocate path cache entry: ");
+    entry->name = strdup(name);
+    entry->dir = num_dirs;
+
+    for (int i = 0; i < num_dirs; i++) {
+        if (!dirs[i].exists)
+            continue;
+        char *candidate;
+        if (asprintf(&candidate, "%s/%s", dirs[i].name, name) == -1)
+            utils_fatal_error("asprintf failed: ");
+        struct stat st;
+        if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode)
+                && access(candidate, X_OK) == 0) {
+            entry->path = candidate;
+            entry->dir = i;
+            break;
+        }
+        free(candidate);
+    }
+    return entry;
+}
+
+const char *
+path_cache_lookup(const char *name)
+{
+    if (cached_path == NULL)
+        path_cache_revalidate();
+
+    struct path_entry **e = find_entry(name);
+    if (e == NULL || *e == NULL) {
+        if (num_entries >= num_buckets / 4 * 3) {
+            grow_table();
+            e = find_entry(name);
+        }
+        *e = search_path(name);
+        num_entries++;
+    }
+    (*e)->hits++;
+    return (*e)->path;
+}
+
+int
+path_cache_forget(const char *name)
+{
+    struct path_entry **e = find_entry(name);
+    if (e == NULL || *e == NULL)
+        return -1;
+    struct path_entry *entry = *e;
+    *e = entry->next;
+    free_entry(entry);
+    num_entries--;
+    return 0;
+}
+
+void
+path_cache_clear(void)
+{
+    drop_entries_from(0);
+}
+
+void
+path_cache_print(FILE *out)
+{
+    if (num_entries == 0) {
+        fprintf(out, "hash: hash table empty\n");
+        return;
+    }
+    fprintf(out, "hits\tcommand\n");
+    for (size_t i = 0; i < num_buckets; i++)
+        for (struct path_entry *e = buckets[i]; e != NULL; e = e->next)
+            if (e->path != NULL)
+                fprintf(out, "%4lu\t%s\n", e->hits, e->path);
+            else
+                fprintf(out, "%4lu\t%s (not found)\n", e->hits, e->name);
+}
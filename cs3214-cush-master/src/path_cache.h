@@ -0,0 +1,36 @@
+#ifndef __PATH_CACHE_H
+#define __PATH_CACHE_H
+
+#include <stdio.h>
+
+/*
+ * A cache of where commands were found on PATH, including commands
+ * that were not found.
+ *
+ * Looking up a command in the cache avoids having the spawned child
+ * try execve() in each PATH directory in turn.  Entries stay valid
+ * as long as PATH is unchanged and none of the directories that were
+ * searched for them changed (by device, inode or mtime); see
+ * path_cache_revalidate().
+ */
+
+/* Drop entries that PATH or directory changes may have made stale.
+ * Call before a batch of lookups. */
+void path_cache_revalidate(void);
+
+/* Return the path to run for command name, which must not contain
+ * a '/', or NULL if it is not an executable file in any PATH
+ * directory.  The result is owned by the cache and valid until the
+ * next call to a path_cache function. */
+const char *path_cache_lookup(const char *name);
+
+/* Forget name; returns -1 if it was not cached */
+int path_cache_forget(const char *name);
+
+/* Forget all commands */
+void path_cache_clear(void);
+
+/* Print the cached commands with their number of uses */
+void path_cache_print(FILE *out);
+
+#endif /* __PATH_CACHE_H */
@@ -0,0 +1,132 @@
+/*
+ * Hash table from process ids to values.
+ *
+ * Used by the shell to find the job a reaped child belongs to
+ * without scanning the job list.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "pid_table.h"
+#include "utils.h"
+
+#define PID_TABLE_MIN_CAPACITY 64
+
+/* Fibonacci hashing; spreads sequentially allocated pids. */
+static size_t
+pid_hash(struct pid_table *table, pid_t pid)
+{
+    return ((uint32_t) pid * 2654435769u) & (table->capacity - 1);
+}
+
+void
+pid_table_init(struct pid_table *table)
+{
+    table->slots = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
+
+void
+pid_table_destroy(struct pid_table *table)
+{
+    free(table->slots);
+    pid_table_init(table);
+}
+
+/* Place an entry known not to be in the table yet. */
+static void
+pid_table_place(struct pid_table *table, pid_t pid, void *value)
+{
+    size_t i = pid_hash(table, pid);
+    while (table->slots[i].pid != 0)
+        i = (i + 1) & (table->capacity - 1);
+
+    table->slots[i].pid = pid;
+    table->slots[i].value = value;
+    table->count++;
+}
+
+/* Rehash into a table with room for at least one more entry at
+ * a load factor of at most 1/2. */
+static void
+pid_table_grow(struct pid_table *table)
+{
+    struct pid_table_entry *old = table->slots;
+    size_t oldcapacity = table->capacity;
+    size_t newcapacity = oldcapacity ? 2 * oldcapacity : PID_TABLE_MIN_CAPACITY;
+
+    table->slots = calloc(newcapacity, sizeof *table->slots);
+    if (table->slots == NULL)
+        utils_fatal_error("cannot grow pid table to %zu entries: ", newcapacity);
+    table->capacity = newcapacity;
+    table->count = 0;
+
+    for (size_t i = 0; i < oldcapacity; i++)
+        if (old[i].pid != 0)
+            pid_table_place(table, old[i].pid, old[i].value);
+    free(old);
+}
+
+/* Return the slot holding pid, or -1 */
+static ssize_t
+pid_table_find(struct pid_table *table, pid_t pid)
+{
+    if (table->capacity == 0)
+        return -1;
+
+    size_t i = pid_hash(table, pid);
+    while (table->slots[i].pid != 0) {
+        if (table->slots[i].pid == pid)
+            return i;
+        i = (i + 1) & (table->capacity - 1);
+    }
+    return -1;
+}
+
+void
+pid_table_insert(struct pid_table *table, pid_t pid, void *value)
+{
+    ssize_t i = pid_table_find(table, pid);
+    if (i != -1) {
+        table->slots[i].value = value;
+        return;
+    }
+    if (2 * (table->count + 1) > table->capacity)
+        pid_table_grow(table);
+    pid_table_place(table, pid, value);
+}
+
+void *
+pid_table_lookup(struct pid_table *table, pid_t pid)
+{
+    ssize_t i = pid_table_find(table, pid);
+    return i == -1 ? NULL : table->slots[i].value;
+}
+
+void *
+pid_table_remove(struct pid_table *table, pid_t pid)
+{
+    ssize_t hole = pid_table_find(table, pid);
+    if (hole == -1)
+        return NULL;
+
+    void *value = table->slots[hole].value;
+    size_t mask = table->capacity - 1;
+
+    /* Backward-shift deletion: move later members of the probe
+     * sequence into the hole so no tombstones are needed. */
+    for (size_t j = (hole + 1) & mask; table->slots[j].pid != 0; j = (j + 1) & mask) {
+        size_t home = pid_hash(table, table->slots[j].pid);
+        /* Entry at j may move to hole unless its home lies
+         * cyclically in (hole, j]. */
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            table->slots[hole] = table->slots[j];
+            hole = j;
+        }
+    }
+    table->slots[hole].pid = 0;
+    table->slots[hole].value = NULL;
+    table->count--;
+    return value;
+}
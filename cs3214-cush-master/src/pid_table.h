@@ -0,0 +1,42 @@
+#ifndef __PID_TABLE_H
+#define __PID_TABLE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * A hash table mapping process ids to an arbitrary value.
+ *
+ * Uses open addressing with linear probing and backward-shift
+ * deletion, so lookups and removals are expected O(1) and never
+ * allocate.  Only insertions may grow the table; callers that
+ * also access the table from a signal handler must insert with
+ * that signal blocked.
+ */
+struct pid_table_entry {
+    pid_t pid;               /* 0 marks an empty slot */
+    void *value;
+};
+
+struct pid_table {
+    struct pid_table_entry *slots;
+    size_t capacity;         /* always a power of 2 */
+    size_t count;
+};
+
+/* Initialize an empty table */
+void pid_table_init(struct pid_table *table);
+
+/* Free the memory held by the table */
+void pid_table_destroy(struct pid_table *table);
+
+/* Map pid to value, replacing any previous mapping */
+void pid_table_insert(struct pid_table *table, pid_t pid, void *value);
+
+/* Return the value mapped to pid, or NULL */
+void *pid_table_lookup(struct pid_table *table, pid_t pid);
+
+/* Remove pid from the table, returning its value or NULL */
+void *pid_table_remove(struct pid_table *table, pid_t pid);
+
+#endif /* __PID_TABLE_H */
@@ -0,0 +1,39 @@
+#!/usr/bin/python
+#
+# Tests child tracking through pidfds (cush -p): foreground waits,
+# reaping of background jobs while at the prompt, and Ctrl-Z.
+#
+import atexit, proc_check, time
+from testutils import *
+
+console = setup_tests([" -p"])
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# a foreground job is waited for
+sendline("echo hello")
+expect_exact("hello\r\n", "foreground command did not run")
+expect_prompt("Shell did not print expected prompt (2)")
+
+# a background job is reaped while the shell sits at the prompt
+sendline("sleep 1 &")
+(jobid, pid) = parse_bg_status()
+expect_prompt("Shell did not print expected prompt (3)")
+time.sleep(2)
+assert not os.path.exists("/proc/" + pid + "/stat"), 'the process was not reaped'
+
+# stops are still reported
+sendline("sleep 30")
+proc_check.wait_until_child_is_in_foreground(console)
+sendcontrol('z')
+(jobid,) = expect_regex(r"\[(\d+)\]\s+Stopped\s+sleep 30")
+expect_prompt("Shell did not print expected prompt (4)")
+
+run_builtin('kill', jobid)
+expect_prompt("Shell did not print expected prompt (5)")
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,91 @@
+#!/usr/bin/python
+#
+# Tests builtins as commands of pipelines: their output goes to the
+# next command or to the output file, jobs does not list the job it
+# runs in, ls is the builtin only without arguments, and a command
+# piping into a builtin gets SIGPIPE.  With the spawn helper, notices
+# about background jobs started before are not mixed into a builtin's
+# output.
+#
+import atexit, os, re, shutil, tempfile
+from testutils import *
+
+tmpdir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, tmpdir)
+out = os.path.join(tmpdir, "out")
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("sleep 30 &")
+expect_prompt("Shell did not print expected prompt (2)")
+sendline("sleep 31 &")
+expect_prompt("Shell did not print expected prompt (3)")
+
+sendline("jobs | grep -c Running")
+expect_exact("2\r\n", "jobs output not passed to the pipeline")
+expect_prompt("Shell did not print expected prompt (4)")
+sendline("jobs | grep 31 | tr S s")
+expect_exact("Running\t\tsleep 31", "jobs output not passed along the pipeline")
+expect_prompt("Shell did not print expected prompt (5)")
+assert "sleep 30" not in console.before, 'jobs output not filtered'
+
+sendline("pwd | tr / :")
+expect_exact(os.getcwd().replace("/", ":") + "\r\n", "pwd output not passed to the pipeline")
+expect_prompt("Shell did not print expected prompt (6)")
+
+# ls with arguments or assignments is not the builtin
+open(os.path.join(tmpdir, "listed-entry"), "w").close()
+sendline("ls -1 " + tmpdir)
+expect_exact("listed-entry\r\n", "ls ignored its arguments")
+expect_prompt("Shell did not print expected prompt (7)")
+sendline("PATH=/nonexistent ls")
+expect_exact("no such file or directory", "ls not searched for on the assigned PATH")
+expect_prompt("Shell did not print expected prompt (8)")
+
+sendline("pwd > " + out)
+expect_prompt("Shell did not print expected prompt (9)")
+sendline("jobs >> " + out)
+expect_prompt("Shell did not print expected prompt (10)")
+with open(out) as f:
+    lines = f.read().splitlines()
+assert lines[0] == os.getcwd(), 'pwd output not redirected'
+assert len(lines) == 3 and "sleep 31" in lines[2], 'jobs output not appended'
+
+# the builtin does not read its input
+sendline("yes | pwd")
+expect_exact(os.getcwd() + "\r\n", "builtin at the end of a pipeline")
+expect_prompt("Shell did not print expected prompt (11)")
+
+sendline("jobs | grep -c sleep &")
+expect_exact("2\r\n", "jobs output not passed to a background pipeline")
+sendline("wait %3")
+expect_prompt("Shell did not print expected prompt (12)")
+
+sendline("kill 1")
+expect_prompt("Shell did not print expected prompt (13)")
+sendline("kill 2")
+expect_prompt("Shell did not print expected prompt (14)")
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+console = setup_tests([" -s"])
+expect_prompt("Shell did not print expected prompt (15)")
+
+sendline("sleep 1 & pwd > " + out)
+expect_prompt("Shell did not print expected prompt (16)")
+with open(out) as f:
+    assert f.read() == os.getcwd() + "\n", 'job notice written to the output file'
+
+sendline("sleep 1 & jobs | cat -A")
+expect_exact("Running^I^Isleep 1)$", "jobs output not passed to the pipeline")
+expect_prompt("Shell did not print expected prompt (17)")
+assert re.search(r"\[\d+\] \d+\$", console.before) is None, 'job notice passed to the pipeline'
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
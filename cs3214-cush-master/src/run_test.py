@@ -0,0 +1,66 @@
+#!/usr/bin/python
+#
+# Tests the run builtin: the CPU affinity, nice value, scheduling
+# policy and I/O priority it sets apply to every process of the job,
+# in the foreground and in the background, and bad options are
+# rejected.
+#
+import atexit, os, shutil, stat, tempfile
+from testutils import *
+
+tmpdir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, tmpdir)
+show = os.path.join(tmpdir, "show")
+with open(show, "w") as f:
+    f.write("#!/bin/sh\n"
+            "read pid comm state rest < /proc/$$/stat\n"
+            "set -- $rest\n"
+            "echo cpus $(sed -n 's/^Cpus_allowed_list:\\s*//p' /proc/$$/status)"
+            " nice ${16} policy ${38}\n")
+os.chmod(show, stat.S_IRWXU)
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# SCHED_BATCH is policy 3, SCHED_IDLE 5
+sendline("run --cpus 0 --nice 7 --sched batch -- " + show)
+expect_exact("cpus 0 nice 7 policy 3", "settings not applied")
+expect_prompt("Shell did not print expected prompt (2)")
+
+sendline("run --nice 5 --sched idle " + show + " | " + show)
+expect_exact("nice 5 policy 5", "settings not applied to the pipeline")
+expect_prompt("Shell did not print expected prompt (3)")
+assert "nice 0" not in console.before, 'pipeline stage ran without the settings'
+
+sendline("run --nice 3 " + show + " &")
+expect_exact("nice 3 policy 0", "settings not applied to a background job")
+expect_prompt("Shell did not print expected prompt (4)")
+sendline("wait")
+expect_prompt("Shell did not print expected prompt (5)")
+
+# the settings belong to the job, not the shell
+sendline(show)
+expect_exact("nice 0 policy 0", "settings outlived the job")
+expect_prompt("Shell did not print expected prompt (6)")
+
+if os.path.exists("/usr/bin/ionice") or os.path.exists("/bin/ionice"):
+    sendline("run --ioprio be:2 ionice")
+    expect_exact("best-effort: prio 2", "I/O priority not applied")
+    expect_prompt("Shell did not print expected prompt (7)")
+
+for bad in ["--nice 20", "--sched nosuch", "--cpus 3-1", "--ioprio idle:3"]:
+    sendline("run " + bad + " true")
+    expect_exact("usage: run", "bad option %s accepted" % bad)
+    expect_prompt("Shell did not print expected prompt (8)")
+
+# a CPU that does not exist cannot be used
+sendline("run --cpus %d true" % (os.cpu_count() + 64))
+expect_exact("Invalid argument", "nonexistent CPU accepted")
+expect_prompt("Shell did not print expected prompt (9)")
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,117 @@
+/*
+ * Resource usage accounting for jobs.
+ *
+ * Reaped processes report their usage through wait4(); processes
+ * that are still running are inspected through /proc.
+ */
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "rusage_support.h"
+
+void
+rusage_add(struct rusage *total, const struct rusage *ru)
+{
+    timeradd(&total->ru_utime, &ru->ru_utime, &total->ru_utime);
+    timeradd(&total->ru_stime, &ru->ru_stime, &total->ru_stime);
+    if (ru->ru_maxrss > total->ru_maxrss)
+        total->ru_maxrss = ru->ru_maxrss;
+    total->ru_minflt += ru->ru_minflt;
+    total->ru_majflt += ru->ru_majflt;
+    total->ru_inblock += ru->ru_inblock;
+    total->ru_oublock += ru->ru_oublock;
+    total->ru_nvcsw += ru->ru_nvcsw;
+    total->ru_nivcsw += ru->ru_nivcsw;
+}
+
+/* Convert clock ticks to a timeval */
+static struct timeval
+ticks_to_timeval(unsigned long long ticks)
+{
+    long hz = sysconf(_SC_CLK_TCK);
+    struct timeval tv = {
+        .tv_sec = ticks / hz,
+        .tv_usec = (ticks % hz) * 1000000 / hz
+    };
+    return tv;
+}
+
+/* Open /proc/<pid>/<file> */
+static FILE *
+open_proc_file(pid_t pid, const char *file)
+{
+    char path[64];
+    snprintf(path, sizeof path, "/proc/%d/%s", pid, file);
+    return fopen(path, "r");
+}
+
+int
+rusage_add_live(struct rusage *total, pid_t pid)
+{
+    struct rusage ru;
+    char line[512];
+    memset(&ru, 0, sizeof ru);
+
+    /* CPU time and page faults from /proc/<pid>/stat.  The command
+     * name may contain spaces, so parse from its closing paren. */
+    FILE *f = open_proc_file(pid, "stat");
+    if (f == NULL)
+        return -1;
+    char *rest = NULL;
+    if (fgets(line, sizeof line, f) != NULL)
+        rest = strrchr(line, ')');
+    fclose(f);
+
+    unsigned long long minflt, majflt, utime, stime;
+    if (rest == NULL
+        || sscanf(rest, ") %*c %*d %*d %*d %*d %*d %*u %llu %*u %llu %*u %llu %llu",
+                  &minflt, &majflt, &utime, &stime) != 4)
+        return -1;
+    ru.ru_minflt = minflt;
+    ru.ru_majflt = majflt;
+    ru.ru_utime = ticks_to_timeval(utime);
+    ru.ru_stime = ticks_to_timeval(stime);
+
+    /* Peak RSS and context switches */
+    f = open_proc_file(pid, "status");
+    if (f != NULL) {
+        while (fgets(line, sizeof line, f) != NULL) {
+            if (sscanf(line, "VmHWM: %ld", &ru.ru_maxrss) == 1)
+                continue;
+            if (sscanf(line, "voluntary_ctxt_switches: %ld", &ru.ru_nvcsw) == 1)
+                continue;
+            sscanf(line, "nonvoluntary_ctxt_switches: %ld", &ru.ru_nivcsw);
+        }
+        fclose(f);
+    }
+
+    /* Block I/O, in the same 512-byte units getrusage() uses */
+    f = open_proc_file(pid, "io");
+    if (f != NULL) {
+        unsigned long long bytes;
+        while (fgets(line, sizeof line, f) != NULL) {
+            if (sscanf(line, "read_bytes: %llu", &bytes) == 1)
+                ru.ru_inblock = bytes / 512;
+            else if (sscanf(line, "write_bytes: %llu", &bytes) == 1)
+                ru.ru_oublock = bytes / 512;
+        }
+        fclose(f);
+    }
+
+    rusage_add(total, &ru);
+    return 0;
+}
+
+void
+rusage_print(FILE *out, const struct rusage *ru)
+{
+    fprintf(out, "user %ld.%03lds sys %ld.%03lds maxrss %ld KiB"
+            " inblock %ld oublock %ld csw %ld/%ld",
+            (long) ru->ru_utime.tv_sec, (long) ru->ru_utime.tv_usec / 1000,
+            (long) ru->ru_stime.tv_sec, (long) ru->ru_stime.tv_usec / 1000,
+            ru->ru_maxrss, ru->ru_inblock, ru->ru_oublock,
+            ru->ru_nvcsw, ru->ru_nivcsw);
+}
@@ -0,0 +1,19 @@
+#ifndef __RUSAGE_SUPPORT_H
+#define __RUSAGE_SUPPORT_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+/* Add the usage of a reaped process (as reported by wait4) to total.
+ * Times and counters are summed; ru_maxrss becomes the maximum. */
+void rusage_add(struct rusage *total, const struct rusage *ru);
+
+/* Add the usage so far of live process pid, read from /proc, to
+ * total.  Returns -1 if the process could not be inspected. */
+int rusage_add_live(struct rusage *total, pid_t pid);
+
+/* Print usage as a single line (without newline) */
+void rusage_print(FILE *out, const struct rusage *ru);
+
+#endif /* __RUSAGE_SUPPORT_H */
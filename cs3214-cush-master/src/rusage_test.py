@@ -0,0 +1,29 @@
+#!/usr/bin/python
+#
+# Tests per-job resource accounting: jobs -l, and the summary
+# printed when a job completes (cush -r).
+#
+import atexit, proc_check, time
+from testutils import *
+
+console = setup_tests([" -r"])
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# jobs -l follows each job with its usage so far
+sendline("sleep 2 &")
+(jobid, pid) = parse_bg_status()
+expect_prompt("Shell did not print expected prompt (2)")
+sendline("jobs -l")
+expect_regex(r"\[" + jobid + r"\]\s+(Running)\s+sleep 2")
+expect_regex(r"\s+user (\d+\.\d+)s sys (\d+\.\d+)s maxrss (\d+) KiB")
+expect_prompt("Shell did not print expected prompt (3)")
+
+# the job's usage is reported once it completes
+expect_regex(r"\[" + jobid + r"\]\s+user \d+\.\d+s sys \d+\.\d+s maxrss ([1-9]\d*) KiB")
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -5,12 +5,14 @@
  * Virginia Tech.
  */
 
+#define _GNU_SOURCE 1
 #include <signal.h>
 #include <assert.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <spawn.h>
 
 #include "signal_support.h"
 #include "utils.h"
@@ -82,4 +84,30 @@ signal_set_handler(int sig, sa_sigaction_t handler)
 
     if (sigaction(sig, &sa, NULL) != 0)
         utils_fatal_error("sigaction failed for signal %d", sig);
+    signal_note_handler(sig);
+}
+
+/* Record that a handler may be installed for signal 'sig', so that
+ * spawned children reset it before they exec. Once one signal has
+ * been recorded, children reset only recorded signals. */
+void
+signal_note_handler(int sig)
+{
+    if (posix_spawn_addhandled_np(sig) != 0)
+        utils_fatal_error("cannot record handler for signal %d", sig);
+}
+
+/* Record every signal that has a handler installed now, whoever
+ * installed it: readline, a sanitizer runtime, or signal_set_handler().
+ * This takes a sigaction() call per signal, so call it where handlers
+ * installed by others may have changed, not for every spawn. */
+void
+signal_note_installed_handlers(void)
+{
+    for (int sig = 1; sig < NSIG; sig++) {
+        struct sigaction sa;
+        if (sigaction(sig, NULL, &sa) == 0
+            && sa.sa_handler != SIG_DFL && sa.sa_handler != SIG_IGN)
+            signal_note_handler(sig);
+    }
 }
@@ -19,4 +19,10 @@ bool signal_unblock(int sig);
 /* Install signal handler for signal 'sig' */
 void signal_set_handler(int sig, sa_sigaction_t handler);
 
+/* Record that a handler may be installed for signal 'sig' */
+void signal_note_handler(int sig);
+
+/* Record every signal that has a handler installed now */
+void signal_note_installed_handlers(void);
+
 #endif /* __SIGNAL_SUPPORT_H */
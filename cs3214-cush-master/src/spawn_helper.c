@@ -0,0 +1,520 @@
+/*
+ * Spawning pipelines from a helper process.
+ *
+ * A request is a fixed header followed by a buffer of int32s and
+ * NUL-terminated strings: the redirections, then for each stage its
+ * dup_stderr flag, argument count, path, file, arguments, number of
+ * assignments and assignments, and last the environment if it changed
+ * since the previous request.  Absent strings are sent as empty ones.
+ * The helper keeps the environment in its own copy of the env_table
+ * module, and applies the assignments to it as the shell would.  The
+ * fds travel with the header.  The reply is one fixed message per stage,
+ * with its pidfd attached.
+ */
+#define _GNU_SOURCE 1
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+
+#include "env_table.h"
+#include "spawn_helper.h"
+#include "utils.h"
+
+struct request {
+    uint32_t size;          /* of the buffer that follows */
+    int32_t nstages;
+    int32_t nworkers;
+    int32_t nenv;           /* -1 if the environment is unchanged */
+    int32_t output_append;
+    uint32_t output_mode;
+    int32_t pgrp;
+    int32_t flags;
+    int32_t nice;
+    int32_t ioprio;
+    int32_t policy;
+    struct sched_param schedparam;
+    sigset_t sigmask;
+    cpu_set_t cpus;
+    uint32_t rlimitmask;
+    struct rlimit rlimits[RLIM_NLIMITS];
+};
+
+struct reply {
+    int32_t pid;
+    int32_t err;
+    int32_t searched;
+};
+
+/* Most fds sent with a message: the terminal and the cgroup */
+#define MAX_FDS 2
+
+/* Replies to the requests sent but not collected must fit the socket
+ * buffer, or the helper would block until the shell reads them while
+ * the shell blocks sending the next request.  Each reply takes up a
+ * buffer of several hundred bytes in the default 208 KiB. */
+#define MAX_PENDING_STAGES 128
+
+static int helper_fd = -1;
+static int pending_stages;
+/* The env_table generation the helper has, or 0 */
+static unsigned long helper_env_generation;
+
+struct buffer {
+    char *data;
+    size_t len, cap;
+};
+
+static void
+put(struct buffer *b, const void *p, size_t n)
+{
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->len + n)
+            cap *= 2;
+        char *data = realloc(b->data, cap);
+        if (data == NULL)
+            utils_fatal_error("cannot grow spawn request: ");
+        b->data = data;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static void
+put_int(struct buffer *b, int32_t v)
+{
+    put(b, &v, sizeof v);
+}
+
+static void
+put_str(struct buffer *b, const char *s)
+{
+    if (s == NULL)
+        s = "";
+    put(b, s, strlen(s) + 1);
+}
+
+struct reader {
+    char *p, *end;
+    bool ok;                /* false once the buffer ran out */
+};
+
+static int32_t
+get_int(struct reader *r)
+{
+    int32_t v = 0;
+    if (r->end - r->p < sizeof v)
+        r->ok = false;
+    else {
+        memcpy(&v, r->p, sizeof v);
+        r->p += sizeof v;
+    }
+    return v;
+}
+
+static char *
+get_str(struct reader *r)
+{
+    char *nul = memchr(r->p, '\0', r->end - r->p);
+    if (nul == NULL) {
+        r->ok = false;
+        return NULL;
+    }
+    char *s = r->p;
+    r->p = nul + 1;
+    return s;
+}
+
+/* A string that is absent if empty */
+static char *
+get_opt_str(struct reader *r)
+{
+    char *s = get_str(r);
+    return s != NULL && *s != '\0' ? s : NULL;
+}
+
+/* Send all of iov, with nfds fds attached to its first byte.
+ * Returns 0 or an error code. */
+static int
+send_with_fds(int fd, struct iovec *iov, int iovcnt, const int *fds, int nfds)
+{
+    union {
+        char buf[CMSG_SPACE(MAX_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = iovcnt };
+    if (nfds > 0) {
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+    }
+
+    while (msg.msg_iovlen > 0) {
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        msg.msg_control = NULL;
+        msg.msg_controllen = 0;
+        while (msg.msg_iovlen > 0 && n >= msg.msg_iov->iov_len) {
+            n -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = (char *) msg.msg_iov->iov_base + n;
+            msg.msg_iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+/* Receive exactly size bytes into buf, and the fds that come with
+ * them, up to maxfds of which are stored in fds.  The fds are
+ * close-on-exec.  Returns false on EOF or error. */
+static bool
+recv_with_fds(int fd, void *buf, size_t size, int *fds, int *nfds, int maxfds)
+{
+    *nfds = 0;
+    size_t got = 0;
+    while (got < size) {
+        union {
+            char buf[CMSG_SPACE(MAX_FDS * sizeof(int))];
+            struct cmsghdr align;
+        } control;
+        struct iovec iov = { (char *) buf + got, size - got };
+        struct msghdr msg = {
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+            .msg_control = control.buf,
+            .msg_controllen = sizeof control.buf
+        };
+        ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+             cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+                continue;
+            int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (int i = 0; i < count; i++) {
+                int received;
+                memcpy(&received, CMSG_DATA(cmsg) + i * sizeof(int), sizeof received);
+                if (*nfds < maxfds)
+                    fds[(*nfds)++] = received;
+                else
+                    close(received);
+            }
+        }
+        got += n;
+    }
+    return true;
+}
+
+/* Spawn the pipeline described by req and buf, and reply */
+static void
+helper_run(int fd, const struct request *req, char *buf, const int *fds, int nfds)
+{
+    struct reader r = { buf, buf + req->size, true };
+    int nstages = req->nstages;
+    struct posix_spawn_pipeline pipeline = {
+        .nstages = nstages,
+        .nworkers = req->nworkers,
+        .output_append = req->output_append,
+        .output_mode = req->output_mode,
+    };
+    pipeline.input = get_opt_str(&r);
+    pipeline.output = get_opt_str(&r);
+
+    struct posix_spawn_stage *stages = calloc(nstages, sizeof *stages);
+    struct env_assignments *assignments = calloc(nstages, sizeof *assignments);
+    char **argvs = NULL, **words = NULL, **envp = NULL;
+    if (stages == NULL || assignments == NULL || nstages <= 0 || nstages > req->size)
+        r.ok = false;
+    for (int i = 0; r.ok && i < nstages; i++) {
+        stages[i].dup_stderr = get_int(&r);
+        int argc = get_int(&r);
+        stages[i].path = get_opt_str(&r);
+        stages[i].file = get_opt_str(&r);
+        stages[i].builtin_output = get_opt_str(&r);
+        if (argc < 0 || argc > req->size || (argvs = calloc(argc + 1, sizeof *argvs)) == NULL) {
+            r.ok = false;
+            break;
+        }
+        stages[i].argv = argvs;
+        for (int j = 0; j < argc; j++)
+            argvs[j] = get_str(&r);
+        int n = get_int(&r);
+        if (n < 0 || n > req->size || (words = calloc(n + 1, sizeof *words)) == NULL) {
+            r.ok = false;
+            break;
+        }
+        assignments[i] = (struct env_assignments) { .words = words, .n = n };
+        for (int j = 0; j < n; j++)
+            words[j] = get_str(&r);
+    }
+    if (r.ok && req->nenv >= 0) {
+        if (req->nenv <= req->size && (envp = calloc(req->nenv + 1, sizeof *envp)) != NULL)
+            for (int i = 0; i < req->nenv; i++)
+                envp[i] = get_str(&r);
+        else
+            r.ok = false;
+        if (r.ok)
+            env_table_init(envp);
+    }
+
+    if (r.ok) {
+        posix_spawnattr_t attr;
+        posix_spawnattr_init(&attr);
+        posix_spawnattr_setflags(&attr, req->flags | POSIX_SPAWN_SETPARENT);
+        posix_spawnattr_setpgroup(&attr, req->pgrp);
+        posix_spawnattr_setsigmask(&attr, &req->sigmask);
+        posix_spawnattr_setnice_np(&attr, req->nice);
+        posix_spawnattr_setioprio_np(&attr, req->ioprio);
+        posix_spawnattr_setschedpolicy(&attr, req->policy);
+        posix_spawnattr_setschedparam(&attr, &req->schedparam);
+        posix_spawnattr_setaffinity_np(&attr, sizeof req->cpus, &req->cpus);
+        posix_spawnattr_setrlimit_np(&attr, req->rlimitmask, req->rlimits);
+        int next_fd = 0;
+        if ((req->flags & POSIX_SPAWN_TCSETPGROUP) && next_fd < nfds)
+            posix_spawnattr_tcsetpgrp_np(&attr, fds[next_fd++]);
+        if ((req->flags & POSIX_SPAWN_SETCGROUP) && next_fd < nfds)
+            posix_spawnattr_setcgroup_np(&attr, fds[next_fd++]);
+        pipeline.stages = stages;
+        posix_spawn_pipeline_np(&pipeline, &attr,
+                                env_table_begin_spawn(&pipeline, assignments));
+        env_table_end_spawn(&pipeline);
+        posix_spawnattr_destroy(&attr);
+    }
+
+    for (int i = 0; i < nstages; i++) {
+        struct reply reply = { .err = EINVAL };
+        int pidfd = -1;
+        if (r.ok) {
+            reply = (struct reply) {
+                .pid = stages[i].pid,
+                .err = stages[i].err,
+                .searched = stages[i].searched
+            };
+            pidfd = stages[i].pidfd;
+        }
+        struct iovec iov = { &reply, sizeof reply };
+        send_with_fds(fd, &iov, 1, &pidfd, pidfd != -1);
+        if (pidfd != -1)
+            close(pidfd);
+    }
+
+    for (int i = 0; stages != NULL && i < nstages; i++)
+        free((void *) stages[i].argv);
+    for (int i = 0; assignments != NULL && i < nstages; i++)
+        free((void *) assignments[i].words);
+    free(stages);
+    free(assignments);
+    free(envp);
+}
+
+/* The helper's main loop.  It exits once the shell closes its end. */
+static void
+helper_serve(int fd)
+{
+    struct request req;
+    int fds[MAX_FDS], nfds, none;
+    char *buf = NULL;
+    size_t bufsize = 0;
+    while (recv_with_fds(fd, &req, sizeof req, fds, &nfds, MAX_FDS)) {
+        if (req.size > bufsize) {
+            free(buf);
+            bufsize = req.size;
+            if ((buf = malloc(bufsize)) == NULL)
+                _exit(EXIT_FAILURE);
+        }
+        if (!recv_with_fds(fd, buf, req.size, NULL, &none, 0))
+            break;
+        helper_run(fd, &req, buf, fds, nfds);
+        for (int i = 0; i < nfds; i++)
+            close(fds[i]);
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+bool
+spawn_helper_start(void)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1) {
+        utils_error("cannot create spawn helper socket: ");
+        return false;
+    }
+
+    pid_t shell = getpid();
+    pid_t pid = fork();
+    if (pid == -1) {
+        utils_error("cannot start spawn helper: ");
+        close(sv[0]);
+        close(sv[1]);
+        return false;
+    }
+    if (pid == 0) {
+        /* The helper shares the shell's process group, but signals
+         * sent to the group are for the shell and its jobs.  It
+         * exits with the shell. */
+        sigset_t all;
+        sigfillset(&all);
+        sigprocmask(SIG_SETMASK, &all, NULL);
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() != shell)
+            _exit(EXIT_SUCCESS);
+        close(sv[0]);
+        helper_serve(sv[1]);
+    }
+    close(sv[1]);
+    helper_fd = sv[0];
+    return true;
+}
+
+int
+spawn_helper_fd(void)
+{
+    return helper_fd;
+}
+
+bool
+spawn_helper_reply_ready(int nstages)
+{
+    int queued;
+    if (ioctl(helper_fd, FIONREAD, &queued) == 0 && queued >= nstages * (int) sizeof(struct reply))
+        return true;
+    /* An exited helper sends nothing more, and collecting fails at once */
+    char c;
+    return recv(helper_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+}
+
+bool
+spawn_helper_has_room(int nstages)
+{
+    return pending_stages + nstages <= MAX_PENDING_STAGES;
+}
+
+int
+spawn_helper_submit(const struct posix_spawn_pipeline *pipeline,
+                    const posix_spawnattr_t *attr,
+                    const struct env_assignments assignments[])
+{
+    static struct buffer buf;
+    buf.len = 0;
+
+    short flags;
+    posix_spawnattr_getflags(attr, &flags);
+    struct request req = {
+        .nstages = pipeline->nstages,
+        .nworkers = pipeline->nworkers,
+        .output_append = pipeline->output_append,
+        .output_mode = pipeline->output_mode,
+    };
+    pid_t pgrp;
+    posix_spawnattr_getpgroup(attr, &pgrp);
+    req.pgrp = pgrp;
+    /* The helper blocks all signals; children that would inherit
+     * the caller's mask get ours instead */
+    if (flags & POSIX_SPAWN_SETSIGMASK)
+        posix_spawnattr_getsigmask(attr, &req.sigmask);
+    else
+        sigprocmask(SIG_BLOCK, NULL, &req.sigmask);
+    req.flags = flags | POSIX_SPAWN_SETSIGMASK;
+    int value;
+    posix_spawnattr_getnice_np(attr, &value);
+    req.nice = value;
+    posix_spawnattr_getioprio_np(attr, &value);
+    req.ioprio = value;
+    posix_spawnattr_getschedpolicy(attr, &value);
+    req.policy = value;
+    posix_spawnattr_getschedparam(attr, &req.schedparam);
+    if (flags & POSIX_SPAWN_SETAFFINITY)
+        posix_spawnattr_getaffinity_np(attr, sizeof req.cpus, &req.cpus);
+    const struct rlimit *rlimits;
+    posix_spawnattr_getrlimit_np(attr, &req.rlimitmask, &rlimits);
+    for (unsigned int mask = req.rlimitmask; mask != 0; mask &= mask - 1)
+        req.rlimits[__builtin_ctz(mask)] = rlimits[__builtin_ctz(mask)];
+
+    int fds[MAX_FDS], nfds = 0;
+    if (flags & POSIX_SPAWN_TCSETPGROUP)
+        posix_spawnattr_tcgetpgrp_np(attr, &fds[nfds++]);
+    if (flags & POSIX_SPAWN_SETCGROUP)
+        posix_spawnattr_getcgroup_np(attr, &fds[nfds++]);
+
+    put_str(&buf, pipeline->input);
+    put_str(&buf, pipeline->output);
+    for (int i = 0; i < pipeline->nstages; i++) {
+        const struct posix_spawn_stage *stage = &pipeline->stages[i];
+        int argc = 0;
+        while (stage->argv[argc] != NULL)
+            argc++;
+        put_int(&buf, stage->dup_stderr);
+        put_int(&buf, argc);
+        put_str(&buf, stage->path);
+        put_str(&buf, stage->file);
+        put_str(&buf, stage->builtin_output);
+        for (int j = 0; j < argc; j++)
+            put_str(&buf, stage->argv[j]);
+        int n = assignments != NULL ? assignments[i].n : 0;
+        put_int(&buf, n);
+        for (int j = 0; j < n; j++)
+            put_str(&buf, assignments[i].words[j]);
+    }
+    unsigned long generation = env_table_generation();
+    if (generation == helper_env_generation)
+        req.nenv = -1;
+    else
+        for (char **env = env_table_envp(); *env != NULL; env++, req.nenv++)
+            put_str(&buf, *env);
+    req.size = buf.len;
+
+    struct iovec iov[2] = {
+        { &req, sizeof req },
+        { buf.data, buf.len }
+    };
+    int rc = send_with_fds(helper_fd, iov, 2, fds, nfds);
+    if (rc == 0) {
+        pending_stages += pipeline->nstages;
+        helper_env_generation = generation;
+    }
+    return rc;
+}
+
+int
+spawn_helper_complete(struct posix_spawn_pipeline *pipeline)
+{
+    int rc = 0;
+    for (int i = 0; i < pipeline->nstages; i++) {
+        struct posix_spawn_stage *stage = &pipeline->stages[i];
+        struct reply reply;
+        int pidfd, nfds;
+        if (!recv_with_fds(helper_fd, &reply, sizeof reply, &pidfd, &nfds, 1))
+            reply = (struct reply) { .err = EPIPE };
+        stage->pid = reply.pid;
+        stage->err = reply.err;
+        stage->searched = reply.searched;
+        stage->pidfd = nfds > 0 ? pidfd : -1;
+        if (rc == 0)
+            rc = stage->err;
+    }
+    pending_stages -= pipeline->nstages;
+    return rc;
+}
@@ -0,0 +1,62 @@
+#ifndef __SPAWN_HELPER_H
+#define __SPAWN_HELPER_H
+
+#include <spawn.h>
+#include <stdbool.h>
+
+#include "env_table.h"
+
+/*
+ * A helper process that spawns pipelines on behalf of the shell.
+ *
+ * The helper is forked by spawn_helper_start() while the shell is still
+ * small, and receives requests over a socket: the stages' argument
+ * vectors and assignments, the redirections, the spawn attributes, and
+ * the environment from env_table if it changed since the last request,
+ * with the terminal and cgroup fds passed as SCM_RIGHTS.  It spawns them
+ * with posix_spawn_pipeline_np() and POSIX_SPAWN_SETPARENT, so the
+ * processes are children of the shell, which reaps them and sees them
+ * stop as if it had spawned them itself.  The reply carries each
+ * stage's pid and error, and its pidfd if one was requested.
+ *
+ * Requests are answered in order.  The shell may send several before
+ * it collects the replies, and keeps working while the helper spawns:
+ * it watches spawn_helper_fd() and collects replies as they arrive.
+ * A child may exit before the reply that names it is collected, so a
+ * status change of an unknown child means replies must be collected
+ * until its job is found.
+ */
+
+/* Fork the helper.  Returns false, with a message on stderr, if it
+ * cannot be started. */
+bool spawn_helper_start(void);
+
+/* The socket to watch for replies, or -1 if the helper was not started */
+int spawn_helper_fd(void);
+
+/* Return true if the reply to the oldest request, whose pipeline had
+ * nstages stages, can be collected without waiting, which is also the
+ * case once the helper has exited */
+bool spawn_helper_reply_ready(int nstages);
+
+/* Return true if requests with nstages more stages fit in the socket
+ * without first collecting a reply */
+bool spawn_helper_has_room(int nstages);
+
+/* Ask the helper to spawn pipeline with attr in the environment from
+ * env_table, with assignments applied as env_table_begin_spawn()
+ * would.  Only the inputs of the stages are used, but not their envp;
+ * nothing is kept after the call.  Returns 0, or an error code if the
+ * helper cannot be reached. */
+int spawn_helper_submit(const struct posix_spawn_pipeline *pipeline,
+                        const posix_spawnattr_t *attr,
+                        const struct env_assignments assignments[]);
+
+/* Wait for the reply to the oldest request, whose pipeline had
+ * pipeline->nstages stages, and store their pid, pidfd, err and
+ * searched.  A stage that failed to exec has a pid nonetheless, and
+ * must be reaped.  Returns the error of the first stage that failed,
+ * or 0. */
+int spawn_helper_complete(struct posix_spawn_pipeline *pipeline);
+
+#endif /* __SPAWN_HELPER_H */
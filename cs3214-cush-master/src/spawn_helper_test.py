@@ -0,0 +1,66 @@
+#!/usr/bin/python
+#
+# Tests spawning from the helper process (cush -s): the processes it
+# spawns are children of the shell, which reaps them and sees them
+# stop, commands that cannot be executed leave nothing behind, and
+# builtins find the processes of jobs whose spawn is still pending.
+#
+import atexit, proc_check, time
+from testutils import *
+
+console = setup_tests([" -s"])
+
+def parent_of(pid):
+    with open("/proc/%s/stat" % pid) as f:
+        return int(f.read().rsplit(")", 1)[1].split()[1])
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("echo hello | tr h j")
+expect_exact("jello\r\n", "pipeline did not run")
+expect_prompt("Shell did not print expected prompt (2)")
+
+# background jobs started from one command line
+sendline("sleep 1 & sleep 1 & sleep 1 &")
+pids = [parse_bg_status().pid for i in range(3)]
+expect_prompt("Shell did not print expected prompt (3)")
+for pid in pids:
+    assert parent_of(pid) == get_shell_pid(), 'a job is not a child of the shell'
+time.sleep(2)
+for pid in pids:
+    assert not os.path.exists("/proc/" + pid + "/stat"), 'a job was not reaped'
+
+# a failed command is reaped along with its job
+sendline("nosuchcommand & echo after")
+expect_exact("no such file or directory\r\nafter\r\n", "failed command was not reported")
+expect_prompt("Shell did not print expected prompt (4)")
+shell = get_shell_pid()
+time.sleep(0.5)
+zombies = [entry for entry in os.listdir("/proc") if entry.isdigit()
+           and os.path.exists("/proc/%s/stat" % entry)
+           and parent_of(entry) == shell
+           and open("/proc/%s/stat" % entry).read().rsplit(")", 1)[1].split()[0] == "Z"]
+assert zombies == [], 'a failed command was left a zombie'
+
+# builtins wait for the processes of a job the helper is still spawning
+sendline("sleep 30 & kill 1")
+(jobid, pid) = parse_bg_status()
+expect_prompt("Shell did not print expected prompt (5)")
+time.sleep(0.5)
+assert not os.path.exists("/proc/" + pid + "/stat"), 'kill missed a job being spawned'
+
+# stops are reported to the shell
+sendline("sleep 30")
+proc_check.wait_until_child_is_in_foreground(console)
+sendcontrol('z')
+(jobid,) = expect_regex(r"\[(\d+)\]\s+Stopped\s+sleep 30")
+expect_prompt("Shell did not print expected prompt (6)")
+
+run_builtin('kill', jobid)
+expect_prompt("Shell did not print expected prompt (7)")
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,52 @@
+#!/usr/bin/python
+#
+# Tests the timeout command: a job is sent its timeout signal when
+# its deadline passes and is killed if it survives the grace period.
+#
+import atexit, os, proc_check, stat, tempfile, time
+from testutils import *
+
+# a job that ignores SIGTERM
+script = tempfile.NamedTemporaryFile(mode='w', suffix='.sh', delete=False)
+script.write("#!/bin/sh\ntrap '' TERM\nsleep 30\n")
+script.close()
+os.chmod(script.name, stat.S_IRWXU)
+atexit.register(os.unlink, script.name)
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# a foreground job is terminated when its deadline passes
+start = time.time()
+sendline("timeout 1 sleep 10")
+expect_regex(r"\[\d+\]\s+(Timed out)\s+sleep 10")
+expect_prompt("Shell did not print expected prompt (2)")
+elapsed = time.time() - start
+assert 0.9 <= elapsed < 2, 'foreground job was not timed out after 1s'
+
+# a background job that ignores the signal is killed after the grace period
+sendline("timeout -k 0.5 0.5 " + script.name + " &")
+(jobid, pid) = expect_regex(r"\[(\d+)\] (\d+)")
+expect_regex(r"\[" + jobid + r"\]\s+(Timed out)\s+")
+expect_regex(r"\[" + jobid + r"\]\s+(Timed out, killed)\s+")
+time.sleep(0.3)
+assert not os.path.exists("/proc/" + pid) or \
+    open("/proc/" + pid + "/stat").read().split(")")[1].split()[0] == "Z", \
+    'job survived SIGKILL'
+
+# the signal can be chosen
+sendline("timeout -s INT 0.3 sleep 5")
+expect_regex(r"\[\d+\]\s+(Timed out)\s+sleep 5")
+expect_prompt("Shell did not print expected prompt (3)")
+
+# jobs that finish in time are not affected
+sendline("timeout 5 sleep 0.2")
+expect_prompt("Shell did not print expected prompt (4)")
+assert "Timed out" not in console.before, 'job that finished in time was timed out'
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,125 @@
+/*
+ * Binary min-heap of timers.
+ *
+ * Used by the shell to find the job deadline that expires next.
+ */
+#include <stdlib.h>
+
+#include "timer_heap.h"
+#include "utils.h"
+
+#define TIMER_HEAP_MIN_CAPACITY 64
+
+void
+timer_heap_init(struct timer_heap *heap)
+{
+    heap->elems = NULL;
+    heap->count = 0;
+    heap->capacity = 0;
+}
+
+void
+timer_heap_destroy(struct timer_heap *heap)
+{
+    free(heap->elems);
+    timer_heap_init(heap);
+}
+
+void
+timer_heap_elem_init(struct timer_heap_elem *elem)
+{
+    elem->index = TIMER_HEAP_NONE;
+}
+
+bool
+timer_heap_contains(struct timer_heap_elem *elem)
+{
+    return elem->index != TIMER_HEAP_NONE;
+}
+
+/* Put elem at position i */
+static void
+place(struct timer_heap *heap, size_t i, struct timer_heap_elem *elem)
+{
+    heap->elems[i] = elem;
+    elem->index = i;
+}
+
+/* Move the element at i towards the root until its parent expires
+ * no later than it does */
+static void
+sift_up(struct timer_heap *heap, size_t i)
+{
+    struct timer_heap_elem *elem = heap->elems[i];
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (heap->elems[parent]->expiry <= elem->expiry)
+            break;
+        place(heap, i, heap->elems[parent]);
+        i = parent;
+    }
+    place(heap, i, elem);
+}
+
+/* Move the element at i towards the leaves until its children expire
+ * no earlier than it does */
+static void
+sift_down(struct timer_heap *heap, size_t i)
+{
+    struct timer_heap_elem *elem = heap->elems[i];
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= heap->count)
+            break;
+        if (child + 1 < heap->count
+                && heap->elems[child + 1]->expiry < heap->elems[child]->expiry)
+            child++;
+        if (elem->expiry <= heap->elems[child]->expiry)
+            break;
+        place(heap, i, heap->elems[child]);
+        i = child;
+    }
+    place(heap, i, elem);
+}
+
+void
+timer_heap_add(struct timer_heap *heap, struct timer_heap_elem *elem, long long expiry)
+{
+    if (heap->count == heap->capacity) {
+        size_t newcapacity = heap->capacity ? 2 * heap->capacity : TIMER_HEAP_MIN_CAPACITY;
+        heap->elems = realloc(heap->elems, newcapacity * sizeof *heap->elems);
+        if (heap->elems == NULL)
+            utils_fatal_error("cannot grow timer heap to %zu entries: ", newcapacity);
+        heap->capacity = newcapacity;
+    }
+    elem->expiry = expiry;
+    place(heap, heap->count++, elem);
+    sift_up(heap, elem->index);
+}
+
+void
+timer_heap_remove(struct timer_heap *heap, struct timer_heap_elem *elem)
+{
+    size_t i = elem->index;
+    if (i == TIMER_HEAP_NONE)
+        return;
+
+    elem->index = TIMER_HEAP_NONE;
+    struct timer_heap_elem *last = heap->elems[--heap->count];
+    if (last == elem)
+        return;
+
+    /* Fill the hole with the last element, which may belong either
+     * above or below it */
+    place(heap, i, last);
+    if (i > 0 && heap->elems[(i - 1) / 2]->expiry > last->expiry)
+        sift_up(heap, i);
+    else
+        sift_down(heap, i);
+}
+
+struct timer_heap_elem *
+timer_heap_min(struct timer_heap *heap)
+{
+    return heap->count > 0 ? heap->elems[0] : NULL;
+}
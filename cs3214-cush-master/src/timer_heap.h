@@ -0,0 +1,55 @@
+#ifndef __TIMER_HEAP_H
+#define __TIMER_HEAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A binary min-heap of timers ordered by expiry time.
+ *
+ * Timers are embedded in the structure they belong to, like list
+ * elements, and remember their position in the heap, so adding and
+ * removing any timer is O(log n) and finding the earliest is O(1).
+ */
+struct timer_heap_elem {
+    long long expiry;        /* in ms, on any monotonic clock */
+    size_t index;            /* position in the heap, or TIMER_HEAP_NONE */
+};
+
+#define TIMER_HEAP_NONE ((size_t) -1)
+
+struct timer_heap {
+    struct timer_heap_elem **elems;
+    size_t count;
+    size_t capacity;
+};
+
+/* Converts pointer to timer heap element ELEM into a pointer to the
+ * structure that ELEM is embedded inside; see list_entry(). */
+#define timer_heap_entry(ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) &(ELEM)->expiry         \
+                     - offsetof (STRUCT, MEMBER.expiry)))
+
+/* Initialize an empty heap */
+void timer_heap_init(struct timer_heap *heap);
+
+/* Free the storage of a heap; the timers in it are not touched */
+void timer_heap_destroy(struct timer_heap *heap);
+
+/* Initialize a timer that is not in any heap */
+void timer_heap_elem_init(struct timer_heap_elem *elem);
+
+/* True if elem is in a heap */
+bool timer_heap_contains(struct timer_heap_elem *elem);
+
+/* Add elem, which must not be in a heap, to expire at expiry */
+void timer_heap_add(struct timer_heap *heap, struct timer_heap_elem *elem, long long expiry);
+
+/* Remove elem from the heap, if it is in it */
+void timer_heap_remove(struct timer_heap *heap, struct timer_heap_elem *elem);
+
+/* Return the timer that expires first, or NULL if the heap is empty */
+struct timer_heap_elem *timer_heap_min(struct timer_heap *heap);
+
+#endif /* __TIMER_HEAP_H */
@@ -0,0 +1,76 @@
+#!/usr/bin/python
+#
+# Tests the ulimit builtin: limits it sets apply to the commands the
+# shell spawns but not to the shell, limits given with -- apply to
+# that pipeline only, and bad limits are rejected.
+#
+import atexit, os, shutil, stat, tempfile
+from testutils import *
+
+tmpdir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, tmpdir)
+show = os.path.join(tmpdir, "show")
+with open(show, "w") as f:
+    f.write("#!/bin/sh\n"
+            "echo nofile $(ulimit -n) hard $(ulimit -Hn) cpu $(ulimit -t)\n")
+os.chmod(show, stat.S_IRWXU)
+spin = os.path.join(tmpdir, "spin")
+with open(spin, "w") as f:
+    f.write("#!/bin/sh\nwhile :; do :; done\n")
+os.chmod(spin, stat.S_IRWXU)
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("ulimit -n 64")
+expect_prompt("Shell did not print expected prompt (2)")
+sendline(show)
+expect_exact("nofile 64 hard 64 cpu unlimited", "limit not applied")
+expect_prompt("Shell did not print expected prompt (3)")
+sendline("ulimit -n")
+expect_exact("64\r\n", "limit not reported")
+expect_prompt("Shell did not print expected prompt (4)")
+
+# -S changes the soft limit only
+sendline("ulimit -S -n 32")
+expect_prompt("Shell did not print expected prompt (5)")
+sendline(show)
+expect_exact("nofile 32 hard 64", "soft limit not applied")
+expect_prompt("Shell did not print expected prompt (6)")
+
+# limits given with -- apply to that pipeline only
+sendline("ulimit -t 5 -n 16 -- " + show + " | " + show)
+expect_exact("nofile 16 hard 16 cpu 5", "limits not applied to the pipeline")
+expect_prompt("Shell did not print expected prompt (7)")
+sendline("ulimit -t 6 -- " + show + " &")
+expect_exact("nofile 32 hard 64 cpu 6", "limits not applied to a background job")
+expect_prompt("Shell did not print expected prompt (8)")
+sendline("wait")
+expect_prompt("Shell did not print expected prompt (9)")
+sendline(show)
+expect_exact("nofile 32 hard 64 cpu unlimited", "limits outlived the job")
+expect_prompt("Shell did not print expected prompt (10)")
+
+# the kernel enforces them
+sendline("ulimit -t 1 -- " + spin)
+expect_prompt("CPU time limit not enforced")
+
+# the shell's own limits are unchanged
+with open("/proc/%d/limits" % console.pid) as f:
+    assert "Max open files            64 " not in f.read(), "limit applied to the shell"
+
+sendline("ulimit -S -n 128")
+expect_exact("soft limit exceeds hard limit", "soft limit above hard limit accepted")
+expect_prompt("Shell did not print expected prompt (11)")
+
+for bad in ["-x 1", "-n abc", "-n -- true", "-n 5 --"]:
+    sendline("ulimit " + bad)
+    expect_exact("usage: ulimit", "bad option %s accepted" % bad)
+    expect_prompt("Shell did not print expected prompt (12)")
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
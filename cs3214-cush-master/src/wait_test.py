@@ -0,0 +1,71 @@
+#!/usr/bin/python
+#
+# Tests the wait builtin: waiting for all background jobs, for any
+# one of them, and for specific jobs, also long after they finished,
+# and interrupting a wait with Ctrl-C.
+#
+import atexit, proc_check, time
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# wait -n returns once the first job finishes
+sendline("sleep 1 &")
+(jobid1, pid1) = parse_bg_status()
+expect_prompt("Shell did not print expected prompt (2)")
+sendline("sleep 2 &")
+(jobid2, pid2) = parse_bg_status()
+expect_prompt("Shell did not print expected prompt (3)")
+sendline("wait -n")
+expect_prompt("Shell did not print expected prompt (4)")
+assert not os.path.exists("/proc/" + pid1 + "/stat"), 'wait -n returned too early'
+assert os.path.exists("/proc/" + pid2 + "/stat"), 'wait -n waited for all jobs'
+
+# wait without arguments waits for all of them
+sendline("wait")
+expect_prompt("Shell did not print expected prompt (5)")
+assert not os.path.exists("/proc/" + pid2 + "/stat"), 'wait returned too early'
+
+# unknown jobs are reported
+sendline("wait %99")
+expect_exact("wait: %99: no such job", "no error for unknown job")
+expect_prompt("Shell did not print expected prompt (6)")
+
+# Ctrl-C ends a wait, but not the shell
+sendline("sleep 30 &")
+(jobid, pid) = parse_bg_status()
+expect_prompt("Shell did not print expected prompt (7)")
+sendline("wait")
+time.sleep(0.5)
+sendintr()
+expect_prompt("Shell did not print expected prompt (8)")
+assert os.path.exists("/proc/" + pid + "/stat"), 'Ctrl-C reached the background job'
+run_builtin('kill', jobid)
+expect_prompt("Shell did not print expected prompt (9)")
+
+# the statuses of many finished jobs are kept
+njobs = 100
+sendline(" ".join(["sleep 0.2 &"] * njobs))
+jobids = [parse_bg_status()[0] for i in range(njobs)]
+expect_prompt("Shell did not print expected prompt (10)")
+time.sleep(1)
+sendline("wait %" + jobids[0] + " %" + jobids[-1])
+expect_prompt("Shell did not print expected prompt (11)")
+assert "no such job" not in console.before, 'the status of a finished job was lost'
+
+# wait on a specific job sets the status the shell exits with on EOF
+sendline("false &")
+(jobid, pid) = parse_bg_status()
+expect_prompt("Shell did not print expected prompt (12)")
+sendline("wait %" + jobid)
+expect_prompt("Shell did not print expected prompt (13)")
+
+console.sendeof()
+console.expect(pexpect.EOF)
+console.close()
+assert console.exitstatus == 1, 'shell did not exit with the status of the waited-for job'
+
+test_success()